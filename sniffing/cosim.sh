@@ -0,0 +1,129 @@
+#!/bin/bash
+# Co-simulation of the FPGA capture pipeline and the host extcap.
+#
+# cosim_tb.vhd runs top.vhd (spi -> circular_buffer -> uart_transmitter) in
+# GHDL and writes the decoded UART bytes into a FIFO; cosim_bridge.py plays
+# them into a pty at the UART baud rate, and the extcap captures from that pty.
+# cosim_check.py then compares what the extcap captured with the stimulus.
+#
+# Usage:
+#   ./cosim.sh run <sclk_hz> <burst_bits> [burst_count]
+#   ./cosim.sh sweep                      (SWEEP_SCLK / SWEEP_BURST override the grid)
+#
+# Needs ghdl, python3 and the extcap and tools built (make build_extcap tools
+# in wireshark/). Results go to cosim_out/, the sweep table to cosim_out/results.md.
+
+set -e
+cd "$(dirname "$0")"
+
+BUILD_DIR=../wireshark/wireshark_extcap/build
+EXTCAP=$BUILD_DIR/extcap_uart
+CONVERT=$BUILD_DIR/spi_convert
+OUT_DIR=${OUT_DIR:-cosim_out}
+BRIDGE_TIMEOUT_S=10   # for cosim_bridge.py to create its pty
+
+# The UART baud rate of the design; the testbench receiver, the bridge and the
+# extcap all follow it, and cosim_check.py gets it from the run summary
+BAUD=$(sed -n 's/^ *constant BAUD_RATE_CONSTANT *: *integer *:= *\([0-9_]*\) *;.*/\1/p' constants.vhd | tr -d _)
+if [ -z "$BAUD" ]; then
+    echo "Could not read BAUD_RATE_CONSTANT from constants.vhd" >&2
+    exit 1
+fi
+
+SWEEP_SCLK=${SWEEP_SCLK:-"100000 200000 500000 1000000 5000000 10000000"}
+SWEEP_BURST=${SWEEP_BURST:-"1024 8192 32768"}
+
+compile() {
+    echo "Compiling VHDL files..."
+    rm -f work-obj08.cf
+
+    # Same order as run.sh, with the simulation model of the PLL in place of
+    # the altpll wrapper
+    ghdl -a --std=08 constants.vhd
+    ghdl -a --std=08 pll_200mhz_sim.vhd
+    ghdl -a --std=08 circular_buffer.vhd
+    ghdl -a --std=08 serial_transmit.vhd
+    ghdl -a --std=08 spi.vhd
+    ghdl -a --std=08 top.vhd
+    ghdl -a --std=08 cosim_tb.vhd
+
+    echo "Elaborating testbench..."
+    ghdl -e --std=08 cosim_tb
+}
+
+# Runs one case and prints its table row
+run_case() {
+    local sclk=$1 burst=$2 count=${3:-4}
+    local dir=$OUT_DIR/${sclk}hz_${burst}bits_${count}
+    rm -rf "$dir"
+    mkdir -p "$dir"
+    mkfifo "$dir/uart.fifo"
+
+    python3 cosim_bridge.py "$dir/uart.fifo" "$dir/tty" "$BAUD" > "$dir/bridge.log" 2>&1 &
+    local bridge=$!
+    local waited=0
+    while [ ! -e "$dir/tty" ]; do
+        if ! kill -0 $bridge 2>/dev/null; then
+            echo "cosim_bridge.py exited before creating its pty, see $dir/bridge.log" >&2
+            return 1
+        fi
+        if [ $waited -ge $((BRIDGE_TIMEOUT_S * 10)) ]; then
+            echo "cosim_bridge.py did not create its pty within ${BRIDGE_TIMEOUT_S} s, see $dir/bridge.log" >&2
+            kill $bridge 2>/dev/null || true
+            return 1
+        fi
+        sleep 0.1
+        waited=$((waited + 1))
+    done
+
+    # The extcap writes into an existing FIFO or file, as Wireshark provides one
+    : > "$dir/capture.pcap"
+    "$EXTCAP" --capture --fifo "$dir/capture.pcap" --serial-device "$dir/tty" --baudrate "$BAUD" \
+        > "$dir/extcap.log" 2>&1 &
+    local extcap=$!
+
+    echo "Running simulation: SCLK $sclk Hz, $count bursts of $burst bits..." >&2
+    ghdl -r --std=08 cosim_tb \
+        -gSCLK_FREQ_HZ="$sclk" -gBURST_BITS="$burst" -gBURST_COUNT="$count" -gHOST_BAUD="$BAUD" \
+        -gUART_FILE="$dir/uart.fifo" -gEXPECTED_FILE="$dir/expected.txt" -gSUMMARY_FILE="$dir/summary.txt" \
+        > "$dir/ghdl.log" 2>&1
+
+    wait $bridge
+    kill -TERM $extcap 2>/dev/null || true
+    wait $extcap || true
+
+    "$CONVERT" --input "$dir/capture.pcap" --output "$dir/records.raw" --format raw > /dev/null
+    python3 cosim_check.py "$dir"
+}
+
+if [ ! -x "$EXTCAP" ] || [ ! -x "$CONVERT" ]; then
+    echo "Build the extcap and tools first: make -C ../wireshark build_extcap tools" >&2
+    exit 1
+fi
+
+case "$1" in
+    run)
+        if [ -z "$2" ] || [ -z "$3" ]; then
+            echo "Usage: $0 run <sclk_hz> <burst_bits> [burst_count]" >&2
+            exit 1
+        fi
+        compile
+        python3 cosim_check.py --header
+        run_case "$2" "$3" "$4"
+        ;;
+    sweep)
+        compile
+        mkdir -p "$OUT_DIR"
+        python3 cosim_check.py --header | tee "$OUT_DIR/results.md"
+        for sclk in $SWEEP_SCLK; do
+            for burst in $SWEEP_BURST; do
+                run_case "$sclk" "$burst" 2 | tee -a "$OUT_DIR/results.md"
+            done
+        done
+        echo "Results written to $OUT_DIR/results.md"
+        ;;
+    *)
+        echo "Usage: $0 run <sclk_hz> <burst_bits> [burst_count] | $0 sweep" >&2
+        exit 1
+        ;;
+esac
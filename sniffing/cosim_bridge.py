@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+# Forwards the UART bytes written by cosim_tb (into a FIFO) to a pseudo
+# terminal, so the extcap can read the simulated FPGA like a real serial port.
+#
+# The simulator runs far slower than real time, so the stream is collected
+# first and then played into the pty at the UART baud rate, back to back like
+# the FPGA sends a full buffer. Like a USB serial adapter, the bridge does not
+# wait for a host that falls behind: what does not fit into the pty is lost.
+# Losses are whole records, so the rest of the run can still be checked.
+#
+# Usage: cosim_bridge.py <uart fifo> <pty link> [baud]
+# <pty link> is created as a symlink to the pty once it is ready.
+
+import fcntl
+import os
+import select
+import sys
+import time
+import tty
+
+RECORD_SIZE = 6
+BITS_PER_BYTE = 10          # 8N1
+SLICE_S = 0.001             # bytes due within this long are written at once
+DEFAULT_BAUD = 12_000_000   # BAUD_RATE_CONSTANT in constants.vhd
+# Give up if the extcap stops reading for this long
+STALL_TIMEOUT_S = 10
+
+
+def read_stream(fifo_path):
+    parts = []
+    # Blocks until the simulator opens the FIFO
+    with open(fifo_path, 'rb', buffering=0) as fifo:
+        while True:
+            chunk = fifo.read(65536)
+            if not chunk:
+                break  # simulation finished
+            parts.append(chunk)
+    return b''.join(parts)
+
+
+def write_nonblocking(fd, data):
+    try:
+        return os.write(fd, data)
+    except BlockingIOError:
+        return 0
+
+
+def play(master, stream, baud):
+    # Returns the number of records dropped because the pty was full, None if
+    # nothing reads the pty at all
+    bytes_per_s = baud / BITS_PER_BYTE
+    slice_bytes = max(RECORD_SIZE, int(bytes_per_s * SLICE_S) // RECORD_SIZE * RECORD_SIZE)
+    fcntl.fcntl(master, fcntl.F_SETFL, fcntl.fcntl(master, fcntl.F_GETFL) | os.O_NONBLOCK)
+
+    dropped = 0
+    start = time.monotonic()
+    for offset in range(0, len(stream), slice_bytes):
+        due = start + offset / bytes_per_s
+        delay = due - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+
+        chunk = stream[offset:offset + slice_bytes]
+        written = write_nonblocking(master, chunk)
+        # Finish a record that went out in part, drop the rest of the slice
+        while written % RECORD_SIZE:
+            _, writable, _ = select.select([], [master], [], STALL_TIMEOUT_S)
+            if not writable:
+                return None
+            written += write_nonblocking(master, chunk[written:written + RECORD_SIZE - written % RECORD_SIZE])
+        dropped += (len(chunk) - written) // RECORD_SIZE
+
+    return dropped
+
+
+def main():
+    if len(sys.argv) not in (3, 4):
+        print("Usage: cosim_bridge.py <uart fifo> <pty link> [baud]", file=sys.stderr)
+        return 1
+    fifo_path, link_path = sys.argv[1], sys.argv[2]
+    baud = int(sys.argv[3]) if len(sys.argv) == 4 else DEFAULT_BAUD
+
+    master, slave = os.openpty()
+    # Raw mode, so no byte of the stream is translated or eaten
+    tty.setraw(slave)
+    if os.path.lexists(link_path):
+        os.unlink(link_path)
+    os.symlink(os.ttyname(slave), link_path)
+
+    stream = read_stream(fifo_path)
+    started = time.monotonic()
+    dropped = play(master, stream, baud)
+    elapsed = time.monotonic() - started
+    if dropped is None:
+        print("[ERROR] Nothing is reading the pty, is the extcap running?", file=sys.stderr)
+        return 1
+
+    # Give the extcap time to read what is still queued in the pty
+    time.sleep(1.0)
+    os.unlink(link_path)
+    os.close(master)
+    os.close(slave)
+    print(f"[INFO] Bridge played {len(stream)} bytes in {elapsed:.3f} s at {baud} baud, "
+          f"{dropped} records dropped because the host fell behind")
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
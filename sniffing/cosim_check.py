@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+# Checks one co-simulation run end to end: the records the extcap captured
+# (converted to a raw dump) against the bits cosim_tb drove, plus the FPGA
+# side counters. Prints one Markdown table row (see cosim.sh).
+#
+# Usage: cosim_check.py <run dir>     expects summary.txt, expected.txt, records.raw
+#        cosim_check.py --header
+
+import os
+import statistics
+import sys
+
+RECORD_SIZE = 6
+SCLK_FREQ_UNIT_HZ = 131072
+CLK_HZ = 200_000_000
+
+
+def cycles_per_record(baud):
+    # uart_transmitter: CLK_HZ // baud cycles per bit, 10 bits and 2 state
+    # cycles per byte, 6 bytes and a fetch per record
+    return 6 * (10 * (CLK_HZ // baud) + 2) + 2
+
+COLUMNS = [
+    "SCLK", "Burst bits", "Bursts", "Sent", "Buffered", "FPGA dropped", "First overflow at bit",
+    "Predicted overflow", "Max fill", "Received", "Host lost", "Corrupt", "Framing errors",
+    "Measured SCLK", "Result",
+]
+
+
+def read_summary(path):
+    summary = {}
+    with open(path) as f:
+        for line in f:
+            key, _, value = line.strip().partition('=')
+            if key:
+                summary[key] = int(value, 0)
+    return summary
+
+
+def read_expected(path):
+    # cycle (64 bit) -> (mosi, miso, cs)
+    expected = {}
+    with open(path) as f:
+        for line in f:
+            cycle, mosi, miso, cs = line.split()
+            expected[int(cycle, 16)] = (int(mosi), int(miso), int(cs))
+    return expected
+
+
+def read_records(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    records = []
+    # The 32-bit timestamps wrap every 21.5 s of simulated time; records come
+    # far more often than that, so a smaller value means one more wrap
+    wraps = 0
+    previous = 0
+    for offset in range(0, len(data) - RECORD_SIZE + 1, RECORD_SIZE):
+        word = int.from_bytes(data[offset:offset + RECORD_SIZE], 'big')
+        ts = word & 0xFFFFFFFF
+        if ts < previous:
+            wraps += 1
+        previous = ts
+        records.append(((wraps << 32) | ts, (word >> 32) & 0x1FFF,
+                        (word >> 46) & 1, (word >> 47) & 1, (word >> 45) & 1))
+    return records
+
+
+def sample_delay(records, cycles):
+    # The sniffer samples a few cycles after the falling edge (synchronizers
+    # and edge detection); take the typical distance to the closest edge before
+    deltas = []
+    for ts, *_ in records[:200]:
+        candidates = [c for c in range(ts - 16, ts + 1) if c in cycles]
+        if candidates:
+            deltas.append(ts - max(candidates))
+    return int(statistics.median(deltas)) if deltas else 0
+
+
+def predicted_overflow(summary):
+    # Bits into a continuous burst until the buffer is full, if it ever is
+    # The baud rate the simulated transmitter used (BAUD_RATE_CONSTANT)
+    drain_hz = CLK_HZ / cycles_per_record(summary['uart_baud'])
+    freq = summary['sclk_freq_hz']
+    if freq <= drain_hz:
+        return None
+    bits = summary['buffer_depth'] / (1 - drain_hz / freq)
+    return int(bits) if bits <= summary['burst_bits'] else None
+
+
+def format_hz(hz):
+    if hz >= 1_000_000:
+        return f"{hz / 1_000_000:g} MHz"
+    return f"{hz / 1000:g} kHz"
+
+
+def check(run_dir):
+    summary = read_summary(os.path.join(run_dir, 'summary.txt'))
+    expected = read_expected(os.path.join(run_dir, 'expected.txt'))
+    records = read_records(os.path.join(run_dir, 'records.raw'))
+
+    delay = sample_delay(records, expected)
+    matched = set()
+    corrupt = 0
+    for ts, _, mosi, miso, cs in records:
+        for cycle in (ts - delay, ts - delay - 1, ts - delay + 1):
+            if cycle in expected and cycle not in matched:
+                matched.add(cycle)
+                if expected[cycle] != (mosi, miso, cs):
+                    corrupt += 1
+                break
+        else:
+            corrupt += 1  # no edge there at all
+
+    freqs = [freq for _, freq, *_ in records if freq]
+    measured = statistics.median(freqs) * SCLK_FREQ_UNIT_HZ if freqs else 0
+
+    dropped = summary['records_dropped']
+    host_lost = summary['records_written'] - len(records)
+    if corrupt or summary['framing_errors']:
+        result = "CORRUPT"
+    elif host_lost > 0:
+        result = "HOST LOSS"
+    elif dropped:
+        result = "OVERFLOW"
+    else:
+        result = "OK"
+
+    predicted = predicted_overflow(summary)
+    first_full = summary['first_full_bit']
+    row = [
+        format_hz(summary['sclk_freq_hz']), summary['burst_bits'], summary['burst_count'],
+        summary['bits_sent'], summary['records_written'], dropped,
+        first_full if first_full >= 0 else "-", predicted if predicted is not None else "-",
+        summary['max_fill'], len(records), host_lost, corrupt, summary['framing_errors'],
+        format_hz(measured) if measured else "-", result,
+    ]
+    return "| " + " | ".join(str(value) for value in row) + " |"
+
+
+def main():
+    if len(sys.argv) == 2 and sys.argv[1] == '--header':
+        print("| " + " | ".join(COLUMNS) + " |")
+        print("|" + "---|" * len(COLUMNS))
+        return 0
+    if len(sys.argv) != 2:
+        print("Usage: cosim_check.py <run dir> | --header", file=sys.stderr)
+        return 1
+    print(check(sys.argv[1]))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
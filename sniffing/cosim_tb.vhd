@@ -0,0 +1,276 @@
+-- ============================================================================
+--  CO-SIMULATION TESTBENCH
+--
+--  Description:
+--      Runs top.vhd (spi -> circular_buffer -> uart_transmitter) under long,
+--      parameterized SPI stimulus and decodes uart_txd like the host UART
+--      would. The received bytes are written to UART_FILE, usually a FIFO
+--      that cosim_bridge.py forwards into a pty for the extcap, so FPGA and
+--      host are tested together (see cosim.sh).
+--
+--  Clock:
+--      - 12 MHz into top.vhd, as on the board. The altpll wrapper cannot be
+--        simulated, so pll_200mhz_sim.vhd is compiled in its place
+--
+--  Outputs:
+--      - UART_FILE     : bytes as received at HOST_BAUD
+--      - EXPECTED_FILE : one line per SCLK falling edge: cycle (hex) mosi miso cs
+--      - SUMMARY_FILE  : key=value counters of the FPGA side (overflow etc.)
+--
+--  Needs VHDL-2008 (external names, to_hstring, flush, finish).
+-- ============================================================================
+
+library IEEE;
+use IEEE.STD_LOGIC_1164.ALL;
+use IEEE.NUMERIC_STD.ALL;
+use IEEE.MATH_REAL.ALL;
+use std.textio.all;
+use std.env.all;
+use work.constants.all;
+
+entity cosim_tb is
+    generic (
+        SCLK_FREQ_HZ  : integer := 1_000_000;    -- SPI clock during a burst
+        BURST_BITS    : integer := 1024;         -- SCLK cycles per CS low period
+        BURST_COUNT   : integer := 4;            -- number of bursts
+        BURST_GAP_US  : integer := 100;          -- CS high time between bursts
+        SEED          : integer := 1;            -- MOSI/MISO pattern
+        HOST_BAUD     : integer := BAUD_RATE_CONSTANT;
+        UART_FILE     : string  := "cosim_uart.bin";
+        EXPECTED_FILE : string  := "cosim_expected.txt";
+        SUMMARY_FILE  : string  := "cosim_summary.txt"
+    );
+end cosim_tb;
+
+architecture sim of cosim_tb is
+
+    function bit_char(value : std_logic) return character is
+    begin
+        if value = '1' then
+            return '1';
+        else
+            return '0';
+        end if;
+    end function;
+
+    constant CLK_12MHZ_PERIOD : time := 83.333 ns;
+    constant SCLK_PERIOD : time := 1 sec / SCLK_FREQ_HZ;
+    constant BIT_TIME    : time := 1 sec / HOST_BAUD;
+
+    -- Board signals of top.vhd; reset is active low there
+    signal clk_12mhz        : std_logic := '0';
+    signal reset            : std_logic := '0';
+    signal sclk             : std_logic := '0';
+    signal miso             : std_logic := '0';
+    signal mosi             : std_logic := '0';
+    signal cs               : std_logic := '1';
+    signal led_miso         : std_logic;
+    signal led_mosi         : std_logic;
+    signal led_cs           : std_logic;
+    signal led_sclk         : std_logic;
+    signal led_pll_lock     : std_logic;
+    signal buffer_empty     : std_logic;  -- led_buffer_empty
+    signal buffer_full      : std_logic;  -- led_buffer_full
+    signal uart_txd         : std_logic;
+
+    -- Bookkeeping
+    signal cycles           : unsigned(63 downto 0) := (others => '0');  -- clock cycles since reset, like timestamp_counter
+    signal bits_sent        : natural := 0;  -- SCLK falling edges driven
+    signal records_written  : natural := 0;  -- records accepted by the buffer
+    signal records_read     : natural := 0;  -- records taken by the UART
+    signal max_fill         : natural := 0;  -- highest buffer occupancy seen
+    signal full_cycles      : unsigned(63 downto 0) := (others => '0');
+    signal first_full_bit   : integer := -1; -- bits_sent when the buffer first filled up
+    signal bytes_received   : natural := 0;
+    signal framing_errors   : natural := 0;
+    signal stim_done        : boolean := false;
+
+begin
+
+    top_inst: entity work.top
+    port map (
+        clk_12mhz        => clk_12mhz,
+        reset            => reset,
+        miso             => miso,
+        mosi             => mosi,
+        cs               => cs,
+        sclk             => sclk,
+        led_miso         => led_miso,
+        led_mosi         => led_mosi,
+        led_cs           => led_cs,
+        led_sclk         => led_sclk,
+        led_pll_lock     => led_pll_lock,
+        led_buffer_empty => buffer_empty,
+        led_buffer_full  => buffer_full,
+        uart_txd         => uart_txd
+    );
+
+    -- Clock generation
+    clk_process: process
+    begin
+        clk_12mhz <= '0';
+        wait for CLK_12MHZ_PERIOD / 2;
+        clk_12mhz <= '1';
+        wait for CLK_12MHZ_PERIOD / 2;
+    end process;
+
+    -- Counters of the FPGA side. The buffer handshake is internal to
+    -- top.vhd, so it is read through external names.
+    monitor_proc: process
+        alias clk is << signal .cosim_tb.top_inst.clk_selected : std_logic >>;
+        alias reset_int is << signal .cosim_tb.top_inst.reset_not : std_logic >>;
+        alias buffer_wr is << signal .cosim_tb.top_inst.buffer_wr : std_logic >>;
+        alias buffer_rd is << signal .cosim_tb.top_inst.buffer_rd : std_logic >>;
+        variable fill : natural;
+    begin
+        wait until rising_edge(clk);
+        if reset_int = '0' then
+            cycles <= cycles + 1;
+
+            if buffer_wr = '1' then
+                records_written <= records_written + 1;
+            end if;
+            if buffer_rd = '1' and buffer_empty = '0' then
+                records_read <= records_read + 1;
+            end if;
+
+            fill := records_written - records_read;
+            if fill > max_fill then
+                max_fill <= fill;
+            end if;
+
+            if buffer_full = '1' then
+                full_cycles <= full_cycles + 1;
+                if first_full_bit < 0 then
+                    first_full_bit <= bits_sent;
+                end if;
+            end if;
+        end if;
+    end process;
+
+    -- SPI master: BURST_COUNT bursts of BURST_BITS random bits, mode 0. Data
+    -- changes a quarter period into the low phase, so it is stable at the
+    -- falling edge where the sniffer samples.
+    stim_proc: process
+        file expected : text open write_mode is EXPECTED_FILE;
+        variable l : line;
+        variable seed1 : positive := SEED;
+        variable seed2 : positive := SEED + 7919;
+        variable r : real;
+        variable mosi_v, miso_v : std_logic;
+    begin
+        reset <= '0';
+        wait for 100 ns;
+        wait until rising_edge(clk_12mhz);
+        reset <= '1';
+        wait for 1 us;
+
+        for burst in 0 to BURST_COUNT-1 loop
+            cs <= '0';
+            wait for SCLK_PERIOD;
+
+            for b in 0 to BURST_BITS-1 loop
+                uniform(seed1, seed2, r);
+                if r >= 0.5 then mosi_v := '1'; else mosi_v := '0'; end if;
+                uniform(seed1, seed2, r);
+                if r >= 0.5 then miso_v := '1'; else miso_v := '0'; end if;
+
+                wait for SCLK_PERIOD / 4;
+                mosi <= mosi_v;
+                miso <= miso_v;
+                wait for SCLK_PERIOD / 4;
+                sclk <= '1';
+                wait for SCLK_PERIOD / 2;
+                sclk <= '0';
+
+                bits_sent <= bits_sent + 1;
+                write(l, to_hstring(cycles));
+                write(l, string'(" " & bit_char(mosi_v) & " " & bit_char(miso_v) & " " & bit_char(cs)));
+                writeline(expected, l);
+            end loop;
+
+            wait for SCLK_PERIOD;
+            cs <= '1';
+            wait for BURST_GAP_US * 1 us;
+        end loop;
+
+        stim_done <= true;
+        wait;
+    end process;
+
+    -- Host UART receiver: 8N1, LSB first, sampled mid-bit at HOST_BAUD
+    uart_rx_proc: process
+        type char_file is file of character;
+        file uart_out : char_file open write_mode is UART_FILE;
+        variable byte_v : std_logic_vector(7 downto 0);
+    begin
+        wait until falling_edge(uart_txd);
+        wait for BIT_TIME / 2;
+
+        if uart_txd = '0' then
+            for i in 0 to 7 loop
+                wait for BIT_TIME;
+                byte_v(i) := uart_txd;
+            end loop;
+            wait for BIT_TIME;
+            if uart_txd /= '1' then
+                framing_errors <= framing_errors + 1;
+            end if;
+
+            write(uart_out, character'val(to_integer(unsigned(byte_v))));
+            flush(uart_out);
+            bytes_received <= bytes_received + 1;
+        end if;
+    end process;
+
+    -- Once the stimulus is done and the buffer has drained, write the
+    -- counters and stop
+    finish_proc: process
+        alias clk is << signal .cosim_tb.top_inst.clk_selected : std_logic >>;
+        alias tx_busy is << signal .cosim_tb.top_inst.uart_tx_inst.tx_busy : std_logic >>;
+        file summary : text open write_mode is SUMMARY_FILE;
+        variable l : line;
+
+        procedure put(key : string; value : integer) is
+        begin
+            write(l, key & "=");
+            write(l, value);
+            writeline(summary, l);
+        end procedure;
+
+        -- Counters that may pass 2**31, in hex
+        procedure put(key : string; value : unsigned) is
+        begin
+            write(l, key & "=0x" & to_hstring(value));
+            writeline(summary, l);
+        end procedure;
+    begin
+        wait until stim_done;
+        loop
+            wait until rising_edge(clk);
+            exit when buffer_empty = '1' and tx_busy = '0';
+        end loop;
+        wait for BIT_TIME * 20;
+
+        put("sclk_freq_hz", SCLK_FREQ_HZ);
+        put("burst_bits", BURST_BITS);
+        put("burst_count", BURST_COUNT);
+        put("buffer_depth", 2**BUFFER_DEPTH_CONSTANT);
+        put("uart_baud", BAUD_RATE_CONSTANT);
+        put("bits_sent", bits_sent);
+        put("records_written", records_written);
+        put("records_dropped", bits_sent - records_written);
+        put("max_fill", max_fill);
+        put("full_cycles", full_cycles);
+        put("first_full_bit", first_full_bit);
+        put("bytes_received", bytes_received);
+        put("framing_errors", framing_errors);
+        put("sim_time_us", now / 1 us);
+
+        report "Co-simulation done: " & integer'image(bits_sent) & " bits sent, " &
+               integer'image(records_written) & " records buffered, " &
+               integer'image(bytes_received) & " UART bytes";
+        finish;
+    end process;
+
+end sim;
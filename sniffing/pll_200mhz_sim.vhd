@@ -0,0 +1,45 @@
+-- ============================================================================
+--  PLL SIMULATION MODEL
+--
+--  Description:
+--      Behavioral stand-in for pll_200mhz.vhd, which wraps Altera's altpll
+--      and cannot be simulated without the vendor libraries. Same entity and
+--      ports, so top.vhd can be simulated unchanged (see cosim.sh). Compile
+--      this file instead of pll_200mhz.vhd, never both.
+--
+--  Clock:
+--      - c0 runs at 200 MHz from the start, not phase aligned to inclk0
+--      - locked rises after LOCK_CYCLES input clock cycles
+--
+-- ============================================================================
+
+library IEEE;
+use IEEE.STD_LOGIC_1164.ALL;
+
+entity pll_200mhz is
+    Port (
+        inclk0  : in  std_logic := '0';  -- 12 MHz input clock
+        c0      : out std_logic;         -- 200 MHz output clock
+        locked  : out std_logic          -- PLL locked signal
+    );
+end pll_200mhz;
+
+architecture sim of pll_200mhz is
+    constant C0_PERIOD   : time := 5 ns;
+    constant LOCK_CYCLES : integer := 10;
+
+    signal c0_i : std_logic := '0';
+begin
+    c0_i <= not c0_i after C0_PERIOD / 2;
+    c0   <= c0_i;
+
+    lock_proc: process
+    begin
+        locked <= '0';
+        for i in 1 to LOCK_CYCLES loop
+            wait until rising_edge(inclk0);
+        end loop;
+        locked <= '1';
+        wait;
+    end process;
+end sim;
@@ -1,14 +1,27 @@
+import os
+import sys
+
 import serial
 
+# C++ record decoder (build with 'make lib' in wireshark/)
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                '..', 'wireshark', 'wireshark_extcap', 'python'))
+import spisniff
+
 port = "/dev/ttyUSB1"
 baud = 12000000
-buffer_size = 6  # or whatever you're sending
+buffer_size = spisniff.RECORD_SIZE  # read at least one record at a time
 
 ser = serial.Serial(port, baud, timeout=1)
+decoder = spisniff.Decoder()
 
 print(f"Listening on {port} at {baud} baud...")
 
 while True:
-    data = ser.read(buffer_size)
-    if data:
-        print(" ".join(f"{b:02X}" for b in data))
\ No newline at end of file
+    # Everything that is waiting, decoded in one call; the decoder keeps a
+    # record split across reads
+    data = ser.read(max(buffer_size, ser.in_waiting))
+    for record in decoder.decode(data):
+        freq_mhz = int(record['sclk_freq']) * spisniff.SCLK_FREQ_UNIT_HZ / 1000000
+        print(f"{record['timestamp']:>14} MISO={record['miso']} MOSI={record['mosi']} "
+              f"CS={record['cs']} SCLK={freq_mhz:.2f}MHz")
@@ -1,6 +1,15 @@
-import serial
+import os
+import sys
 import time
 
+import numpy as np
+import serial
+
+# C++ record decoder (build with 'make lib' in wireshark/)
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                '..', '..', 'wireshark', 'wireshark_extcap', 'python'))
+import spisniff
+
 # Configuration
 PORT = '/dev/ttyUSB2'       # Serial port
 BAUD_RATE = 12000000        # 12 Mbps
@@ -19,8 +28,9 @@ def main():
         # Statistics
         correct_count = 0
         incorrect_count = 0
-        all_bits = []
+        all_bits = np.empty(0, dtype=np.uint8)
         message_start_time = None
+        decoder = spisniff.Decoder()
 
         print(f"Listening for '{TARGET}' messages...")
 
@@ -33,38 +43,28 @@ def main():
                     print(f"✗ Message timeout! Received partial: '{main.buffer}'")
                     main.buffer = ''
                 message_start_time = None
-                all_bits = []
+                all_bits = np.empty(0, dtype=np.uint8)
 
-            # Read data if available
+            # Read everything available, the decoder keeps partial packets
             if ser.in_waiting >= PACKET_SIZE:
-                # Read a packet
-                packet = ser.read(PACKET_SIZE)
+                records = decoder.decode(ser.read(ser.in_waiting))
 
                 # Start timing when we get the first packet for a message
-                if message_start_time is None:
+                if message_start_time is None and records.size:
                     message_start_time = time.time()
 
-                # Extract MOSI bit (bit 46)
-                for i in range(len(packet) // PACKET_SIZE):
-                    offset = i * PACKET_SIZE
-                    if offset + PACKET_SIZE <= len(packet):
-                        value = int.from_bytes(packet[offset:offset+PACKET_SIZE], byteorder='big')
-                        mosi_bit = (value >> 46) & 0x1
-                        all_bits.append(mosi_bit)
-
-            # Process bits when we have enough
-            while len(all_bits) >= 8:
-                # Take 8 bits and convert to a character
-                byte_value = 0
-                for i in range(8):
-                    byte_value = (byte_value << 1) | all_bits[i]
-
-                # Remove the processed bits
-                all_bits = all_bits[8:]
+                # MOSI bit of every packet (bit 46)
+                all_bits = np.concatenate((all_bits, records['mosi']))
 
-                # Convert to ASCII
-                char = chr(byte_value) if 32 <= byte_value <= 126 else '.'
+            # Process bits when we have enough, 8 bits per character
+            if len(all_bits) >= 8:
+                usable = len(all_bits) // 8 * 8
+                chars = spisniff.to_ascii(np.packbits(all_bits[:usable]))
+                all_bits = all_bits[usable:]
+            else:
+                chars = ''
 
+            for char in chars:
                 # Add to the current message buffer
                 current_buffer = getattr(main, 'buffer', '')
                 current_buffer += char
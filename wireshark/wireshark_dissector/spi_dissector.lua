@@ -6,6 +6,7 @@ local spi_post = Proto("0_SPI_Custom", "Grouped SPI Message")
 spi_post.prefs.bits_per_word = Pref.uint("Bits per word", 8, "Number of bits per words (usually 8)")
 spi_post.prefs.packets_per_message = Pref.uint("Words per message", 3, "Number of words in one SPI message")
 spi_post.prefs.sclk_adjust = Pref.uint("SCLK scaling factor", 131072, "Multiplier to compute SCLK frequency (Hz = raw * factor)")
+spi_post.prefs.cached_groups = Pref.uint("Cached message groups", 4096, "Number of message groups kept in memory for re-dissection")
 
 -- Protocol fields
 local f_miso = ProtoField.bool("spi.miso", "MISO", base.NONE, { [1] = "HIGH", [2] = "LOW" })
@@ -33,7 +34,15 @@ proto_spi.fields = {
   f_miso_full_hex 
 }
 
+-- The record dissected last, handed to the post-dissector. frame tells it
+-- whether the current packet is an SPI record at all (e.g. not a bus summary),
+-- meta holds the group metadata of sequenced records (DLT 149).
+local last_record = { frame = nil, mosi = false, miso = false, meta = nil }
+
 function proto_spi.dissector(buffer, pinfo, tree)
+  last_record.frame = pinfo.number
+  last_record.meta = nil
+
   -- What displays in the "protocol" column
   pinfo.cols.protocol = "SPI Sniffer"
 
@@ -73,115 +82,290 @@ function proto_spi.dissector(buffer, pinfo, tree)
   spi_tree:add(f_cs, buffer(0, 1), cs_bit)
   spi_tree:add(f_sclk, buffer(0, 2), display_sclk_freq)
   spi_tree:add(f_timestamp, buffer(2, 4), timestamp):append_text(" (Bytes: ".. timestamp_bytes ..")")
+
+  last_record.mosi = mosi_bit
+  last_record.miso = miso_bit
 end
 
--- Global data (reset at each capture load)
-local packet_bits = {} -- indexed by packet number
+-- Records with sequence and group metadata, one per packet (DLT 149)
+local proto_spi_seq = Proto.new("SPI_Seq", "SPI Record Sequence")
 
--- Convert bit list to ASCII string (non-printables = '.')
-local function bits_to_ascii(bits, bits_per_word)
-    local result = ""
-    local byte, count = 0, 0
+local f_seq_version  = ProtoField.uint8("spi_seq.version", "Version", base.DEC)
+local f_seq_flags    = ProtoField.uint8("spi_seq.flags", "Flags", base.HEX)
+local f_seq_first    = ProtoField.bool("spi_seq.flags.first", "First of Group", 8, nil, 0x01)
+local f_seq_last     = ProtoField.bool("spi_seq.flags.last", "Last of Group", 8, nil, 0x02)
+local f_seq_sequence = ProtoField.uint32("spi_seq.sequence", "Sequence Number", base.DEC)
+local f_seq_group    = ProtoField.uint32("spi_seq.group", "Group", base.DEC)
+local f_seq_position = ProtoField.uint32("spi_seq.position", "Position in Group", base.DEC)
+
+proto_spi_seq.fields = {
+  f_seq_version, f_seq_flags, f_seq_first, f_seq_last, f_seq_sequence, f_seq_group, f_seq_position
+}
 
-    for _, bitval in ipairs(bits) do
-        byte = bit.lshift(byte, 1)
-        if bitval then byte = bit.bor(byte, 1) end
-        count = count + 1
+function proto_spi_seq.dissector(buffer, pinfo, tree)
+  if buffer:len() < 22 then return 0 end
+
+  local flags = buffer(1, 1):uint()
+
+  local seq_tree = tree:add(proto_spi_seq, buffer(0, 16))
+  seq_tree:add(f_seq_version, buffer(0, 1))
+  local flags_tree = seq_tree:add(f_seq_flags, buffer(1, 1))
+  flags_tree:add(f_seq_first, buffer(1, 1))
+  flags_tree:add(f_seq_last, buffer(1, 1))
+  seq_tree:add(f_seq_sequence, buffer(4, 4))
+  seq_tree:add(f_seq_group, buffer(8, 4))
+  seq_tree:add(f_seq_position, buffer(12, 4))
+
+  -- The record itself is decoded like a plain DLT 147 packet
+  Dissector.get("spi"):call(buffer(16):tvb(), pinfo, tree)
+
+  last_record.meta = {
+    group = buffer(8, 4):uint(),
+    position = buffer(12, 4):uint(),
+    last = bit.band(flags, 0x02) ~= 0
+  }
+  return buffer:len()
+end
 
-        if count == bits_per_word then
-            local char = (byte >= 32 and byte <= 126) and string.char(byte) or "."
-            result = result .. char
-            byte = 0
-            count = 0
+-- Message groups, keyed by group number. Each packet adds its bit to its
+-- group in O(1); the last packet turns the group into the message strings,
+-- which is all that is kept. Memory is bounded by two generations of at most
+-- cached_groups / 2 groups each: when the newer one is full the older one is
+-- dropped, and looking up a group moves it into the newer one. A dropped
+-- group is built again when a later pass walks it in order from its first
+-- packet, as applying a display filter does.
+local groups_new, groups_old, groups_count = {}, {}, 0
+
+local function group_store(key, group)
+    if groups_new[key] == nil then
+        local limit = math.max(1, math.floor(spi_post.prefs.cached_groups / 2))
+        if groups_count >= limit then
+            groups_old, groups_new, groups_count = groups_new, {}, 0
         end
+        groups_count = groups_count + 1
     end
+    groups_new[key] = group
+end
 
-    -- Handle partial word at end
-    if count > 0 then
-        byte = bit.lshift(byte, (bits_per_word - count))
-        local char = (byte >= 32 and byte <= 126) and string.char(byte) or "."
-        result = result .. char
+local function group_lookup(key)
+    local group = groups_new[key]
+    if group == nil then
+        group = groups_old[key]
+        if group ~= nil then
+            groups_old[key] = nil
+            group_store(key, group)
+        end
     end
+    return group
+end
 
-    return result
+-- Reset at each capture load and re-dissection
+function spi_post.init()
+    groups_new, groups_old, groups_count = {}, {}, 0
+    last_record.frame = nil
+    last_record.meta = nil
 end
 
--- Convert bit list to Hex string
-local function bits_to_hex(bits)
-    local result = ""
-    local byte, count = 0, 0
+-- Non-printables = '.'
+local function word_to_char(word)
+    return (word >= 32 and word <= 126) and string.char(word) or "."
+end
 
-    for _, bitval in ipairs(bits) do
-        byte = bit.lshift(byte, 1)
-        if bitval then byte = bit.bor(byte, 1) end
-        count = count + 1
+-- Bits of one direction of a group: complete words become ASCII characters
+-- and complete bytes hex digits as the bits arrive
+local function new_bits()
+    return { ascii = {}, hex = {}, word = 0, word_count = 0, byte = 0, byte_count = 0 }
+end
 
-        if count == 8 then
-            result = result .. string.format("%02X", byte)
-            byte = 0
-            count = 0
-        end
+local function push_bit(acc, bitval, bits_per_word)
+    local b = bitval and 1 or 0
+
+    acc.word = bit.bor(bit.lshift(acc.word, 1), b)
+    acc.word_count = acc.word_count + 1
+    if acc.word_count == bits_per_word then
+        acc.ascii[#acc.ascii + 1] = word_to_char(acc.word)
+        acc.word, acc.word_count = 0, 0
     end
 
-    if count > 0 then
-        byte = bit.lshift(byte, (8 - count))
-        result = result .. string.format("%02X", byte)
+    acc.byte = bit.bor(bit.lshift(acc.byte, 1), b)
+    acc.byte_count = acc.byte_count + 1
+    if acc.byte_count == 8 then
+        acc.hex[#acc.hex + 1] = string.format("%02X", acc.byte)
+        acc.byte, acc.byte_count = 0, 0
     end
+end
 
-    return result
+-- Returns the ASCII and hex strings; a partial word at the end is left-aligned
+local function finish_bits(acc, bits_per_word)
+    if acc.word_count > 0 then
+        acc.ascii[#acc.ascii + 1] = word_to_char(bit.lshift(acc.word, bits_per_word - acc.word_count))
+    end
+    if acc.byte_count > 0 then
+        acc.hex[#acc.hex + 1] = string.format("%02X", bit.lshift(acc.byte, 8 - acc.byte_count))
+    end
+    return table.concat(acc.ascii), table.concat(acc.hex)
 end
 
 function spi_post.dissector(buffer, pinfo, tree)
-    if buffer:len() < 1 then return end
-
-    -- Read MOSI and MISO bits from byte
-    local b = buffer(0,1):uint()
-    local mosi = bit.band(b, 0x40) ~= 0  -- bit 6
-    local miso = bit.band(b, 0x80) ~= 0  -- bit 7
+    if last_record.frame ~= pinfo.number then return end -- not an SPI record
 
     local pkt_num = pinfo.number
     local bits_per_word = spi_post.prefs.bits_per_word
-    local group_size = spi_post.prefs.packets_per_message * bits_per_word
 
-    local group_index = math.floor((pkt_num - 1) / group_size) + 1
-    local group_pos   = ((pkt_num - 1) % group_size) + 1
+    local group_key, group_pos, is_last
+    if last_record.meta then
+        -- Groups as the extcap assigned them
+        group_key = last_record.meta.group
+        group_pos = last_record.meta.position
+        is_last = last_record.meta.last
+    else
+        -- Captures without metadata: fixed size groups by frame number
+        local group_size = spi_post.prefs.packets_per_message * bits_per_word
+        group_key = math.floor((pkt_num - 1) / group_size)
+        group_pos = (pkt_num - 1) % group_size
+        is_last = group_pos == group_size - 1
+    end
 
-    -- Store data
-    packet_bits[pkt_num] = { group = group_index, pos = group_pos, mosi = mosi, miso = miso }
+    local group = group_lookup(group_key)
 
-    -- Show group info on every packet
-    local subtree = tree:add(spi_post, "SPI Message Group Info")
-    subtree:add(f_group_info, string.format("Packet %d of Group #%d", group_pos, group_index))
-
-    -- Collect all bits for the group
-    local group_data = {}
-    for i = 1, group_size do
-        local pkt = ((group_index - 1) * group_size) + i
-        local d = packet_bits[pkt]
-        if not d then return end -- Don't show incomplete group
-        table.insert(group_data, d)
+    -- Packets arrive in order on the first pass. Later passes may jump
+    -- around, so a group missing from the cache is only rebuilt from its
+    -- first packet on, and given up if a frame in between is skipped.
+    if not pinfo.visited then
+        if group == nil or group_pos == 0 then
+            group = { next_pos = 0, complete = true, mosi = new_bits(), miso = new_bits() }
+            group_store(group_key, group)
+        end
+    elseif group_pos == 0 and (group == nil or group.last_frame == nil) then
+        group = { next_pos = 0, complete = true, mosi = new_bits(), miso = new_bits() }
+        group_store(group_key, group)
+    elseif group ~= nil and group.mosi and group.next_frame ~= pkt_num then
+        group.mosi, group.miso = nil, nil
     end
 
-    -- Only add full message on last packet of group
-    if group_pos == group_size then
-        local mosi_bits, miso_bits = {}, {}
-        for _, d in ipairs(group_data) do
-            table.insert(mosi_bits, d.mosi)
-            table.insert(miso_bits, d.miso)
+    if group ~= nil and group.mosi then
+        -- A position that does not follow on means records are missing
+        if group_pos ~= group.next_pos then group.complete = false end
+        group.next_pos = group_pos + 1
+        group.next_frame = pkt_num + 1
+
+        push_bit(group.mosi, last_record.mosi, bits_per_word)
+        push_bit(group.miso, last_record.miso, bits_per_word)
+
+        if is_last then
+            group.mosi_ascii, group.mosi_hex = finish_bits(group.mosi, bits_per_word)
+            group.miso_ascii, group.miso_hex = finish_bits(group.miso, bits_per_word)
+            group.mosi, group.miso = nil, nil
+            group.last_frame = pkt_num
         end
+    end
 
-        -- Show both ASCII and Hex
-        subtree:add(f_mosi_full_ascii, bits_to_ascii(mosi_bits, bits_per_word))
-        subtree:add(f_miso_full_ascii, bits_to_ascii(miso_bits, bits_per_word))
+    -- Show group info on every packet
+    local subtree = tree:add(spi_post, "SPI Message Group Info")
+    local info = subtree:add(f_group_info, string.format("Packet %d of Group #%d", group_pos + 1, group_key + 1))
+
+    -- Only add full message on last packet of group
+    if not is_last then return end
 
-        subtree:add(f_mosi_full_hex, bits_to_hex(mosi_bits))
-        subtree:add(f_miso_full_hex, bits_to_hex(miso_bits))
+    if group == nil or group.last_frame ~= pkt_num then
+        info:append_text(" (message no longer cached)")
+        return
     end
+    if not group.complete then
+        info:append_text(" (records missing)")
+    end
+
+    -- Show both ASCII and Hex
+    subtree:add(f_mosi_full_ascii, group.mosi_ascii)
+    subtree:add(f_miso_full_ascii, group.miso_ascii)
+
+    subtree:add(f_mosi_full_hex, group.mosi_hex)
+    subtree:add(f_miso_full_hex, group.miso_hex)
 end
 
 -- Register the post-dissector
 register_postdissector(spi_post)
 
+-- Bus summaries written by the extcap in summary capture mode (DLT 148)
+local proto_spi_summary = Proto.new("SPI_Summary", "SPI Bus Summary")
+
+local f_sum_version      = ProtoField.uint8("spi_summary.version", "Version", base.DEC)
+local f_sum_flags        = ProtoField.uint8("spi_summary.flags", "Flags", base.HEX)
+local f_sum_entries      = ProtoField.uint16("spi_summary.command_entries", "Command Entries", base.DEC)
+local f_sum_interval     = ProtoField.uint32("spi_summary.interval_ms", "Interval (ms)", base.DEC)
+local f_sum_first        = ProtoField.uint64("spi_summary.first_timestamp", "First Record Timestamp", base.DEC)
+local f_sum_last         = ProtoField.uint64("spi_summary.last_timestamp", "Last Record Timestamp", base.DEC)
+local f_sum_records      = ProtoField.uint32("spi_summary.records", "Records", base.DEC)
+local f_sum_transactions = ProtoField.uint32("spi_summary.transactions", "Transactions", base.DEC)
+local f_sum_starts       = ProtoField.uint32("spi_summary.transaction_starts", "Transaction Starts", base.DEC)
+local f_sum_bytes        = ProtoField.uint32("spi_summary.bytes", "Bytes Clocked", base.DEC)
+local f_sum_mosi_active  = ProtoField.uint32("spi_summary.mosi_active", "Active MOSI Bytes", base.DEC)
+local f_sum_miso_active  = ProtoField.uint32("spi_summary.miso_active", "Active MISO Bytes", base.DEC)
+local f_sum_utilization  = ProtoField.uint16("spi_summary.utilization", "Bus Utilization (1/10000)", base.DEC)
+local f_sum_sclk_min     = ProtoField.string("spi_summary.sclk_min", "SCLK Min")
+local f_sum_sclk_max     = ProtoField.string("spi_summary.sclk_max", "SCLK Max")
+local f_sum_sclk_mean    = ProtoField.string("spi_summary.sclk_mean", "SCLK Mean")
+local f_sum_command      = ProtoField.uint8("spi_summary.command", "Command", base.HEX)
+local f_sum_command_count = ProtoField.uint32("spi_summary.command_count", "Transactions", base.DEC)
+
+proto_spi_summary.fields = {
+  f_sum_version, f_sum_flags, f_sum_entries, f_sum_interval, f_sum_first, f_sum_last,
+  f_sum_records, f_sum_transactions, f_sum_starts, f_sum_bytes, f_sum_mosi_active, f_sum_miso_active,
+  f_sum_utilization, f_sum_sclk_min, f_sum_sclk_max, f_sum_sclk_mean, f_sum_command, f_sum_command_count
+}
+
+-- Raw SCLK units to a display string, like the record dissector
+local function sclk_to_string(raw)
+  if raw == 0 then return "none" end
+  local mhz = (raw * spi_post.prefs.sclk_adjust) / 1000000
+  return mhz >= 1 and string.format("%.1f MHz", mhz) or string.format("%.0f kHz", mhz * 1000)
+end
+
+function proto_spi_summary.dissector(buffer, pinfo, tree)
+  if buffer:len() < 60 or buffer(0, 4):string() ~= "SPIS" then return 0 end
+
+  pinfo.cols.protocol = "SPI Summary"
+
+  local entries = buffer(6, 2):uint()
+  local transactions = buffer(32, 4):uint()
+  local utilization = buffer(52, 2):uint()
+  pinfo.cols.info = string.format("%d transactions, %d bytes, %.2f%% busy",
+                                  transactions, buffer(40, 4):uint(), utilization / 100)
+
+  local sum_tree = tree:add(proto_spi_summary, buffer())
+  sum_tree:add(f_sum_version, buffer(4, 1))
+  sum_tree:add(f_sum_flags, buffer(5, 1))
+  sum_tree:add(f_sum_entries, buffer(6, 2))
+  sum_tree:add(f_sum_interval, buffer(8, 4))
+  sum_tree:add(f_sum_first, buffer(12, 8))
+  sum_tree:add(f_sum_last, buffer(20, 8))
+  sum_tree:add(f_sum_records, buffer(28, 4))
+  sum_tree:add(f_sum_transactions, buffer(32, 4))
+  sum_tree:add(f_sum_starts, buffer(36, 4))
+  sum_tree:add(f_sum_bytes, buffer(40, 4))
+  sum_tree:add(f_sum_mosi_active, buffer(44, 4))
+  sum_tree:add(f_sum_miso_active, buffer(48, 4))
+  sum_tree:add(f_sum_utilization, buffer(52, 2)):append_text(string.format(" (%.2f%%)", utilization / 100))
+  sum_tree:add(f_sum_sclk_min, buffer(54, 2), sclk_to_string(buffer(54, 2):uint()))
+  sum_tree:add(f_sum_sclk_max, buffer(56, 2), sclk_to_string(buffer(56, 2):uint()))
+  sum_tree:add(f_sum_sclk_mean, buffer(58, 2), sclk_to_string(buffer(58, 2):uint()))
+
+  -- One entry per first MOSI byte seen in the interval
+  local commands_tree = sum_tree:add(buffer(60), "Commands")
+  for i = 0, entries - 1 do
+    local offset = 60 + i * 5
+    if offset + 5 > buffer:len() then break end
+    local entry = commands_tree:add(buffer(offset, 5),
+                                    string.format("0x%02X: %d", buffer(offset, 1):uint(), buffer(offset + 1, 4):uint()))
+    entry:add(f_sum_command, buffer(offset, 1))
+    entry:add(f_sum_command_count, buffer(offset + 1, 4))
+  end
+
+  return buffer:len()
+end
+
 -- Register the protocol with Wireshark
 spi_table = DissectorTable.get("wtap_encap") -- Use the wtap_encap table for custom DLTs
-spi_table:add(147, proto_spi) -- Register your protocol for DLT 147 (USER0)
\ No newline at end of file
+spi_table:add(147, proto_spi) -- Register your protocol for DLT 147 (USER0)
+spi_table:add(148, proto_spi_summary) -- Bus summaries on DLT 148 (USER1)
+spi_table:add(149, proto_spi_seq) -- Records with group metadata on DLT 149 (USER2)
\ No newline at end of file
@@ -0,0 +1,253 @@
+"""
+NumPy bindings for libspisniff, the C++ record/transaction decoder.
+
+Decoded records and transactions come back as NumPy structured arrays that
+the library fills in place through the buffer protocol, so decoding never
+creates a Python object per record:
+
+    import spisniff
+
+    decoder = spisniff.Decoder()
+    records = decoder.decode(ser.read(ser.in_waiting))
+    mosi_bytes = spisniff.pack_bits(records['mosi'])
+
+    for records in spisniff.read_capture('capture.pcapng'):
+        freqs_hz = records['sclk_freq'].astype(np.uint32) * spisniff.SCLK_FREQ_UNIT_HZ
+
+The library is looked up in $SPISNIFF_LIB, next to this file, and in
+../build (where `make lib` in wireshark/ puts it).
+"""
+
+import ctypes
+import os
+
+import numpy as np
+
+ABI_VERSION = 2
+RECORD_SIZE = 6                 # bytes per record on the UART
+FPGA_CLOCK_HZ = 200_000_000     # timestamp_counter rate
+NS_PER_TICK = 5
+SCLK_FREQ_UNIT_HZ = 131072      # one sclk_freq count
+DEFAULT_GAP_TICKS = 20000       # 100 us, as --group-gap in the extcap
+_ERROR = ctypes.c_size_t(-1).value  # SPISNIFF_ERROR
+
+# Must match spisniff_record / spisniff_transaction in spisniff.h
+RECORD_DTYPE = np.dtype({
+    'names':   ['timestamp', 'sclk_freq', 'miso', 'mosi', 'cs'],
+    'formats': ['<u8', '<u2', 'u1', 'u1', 'u1'],
+    'offsets': [0, 8, 10, 11, 12],
+    'itemsize': 16,
+})
+
+TRANSACTION_DTYPE = np.dtype({
+    'names':   ['start', 'end', 'bits', 'payload_offset'],
+    'formats': ['<u8', '<u8', '<u4', '<u4'],
+    'offsets': [0, 8, 16, 20],
+    'itemsize': 24,
+})
+
+
+def _load_library():
+    here = os.path.dirname(os.path.abspath(__file__))
+    candidates = [
+        os.environ.get('SPISNIFF_LIB'),
+        os.path.join(here, 'libspisniff.so'),
+        os.path.join(here, '..', 'build', 'libspisniff.so'),
+    ]
+    for path in candidates:
+        if path and os.path.exists(path):
+            lib = ctypes.CDLL(path)
+            break
+    else:
+        raise OSError("libspisniff.so not found, build it with 'make lib' in wireshark/ "
+                      "or point SPISNIFF_LIB at it")
+
+    size_t_p = ctypes.POINTER(ctypes.c_size_t)
+
+    lib.spisniff_abi_version.restype = ctypes.c_uint32
+    lib.spisniff_abi_version.argtypes = []
+
+    lib.spisniff_decoder_new.restype = ctypes.c_void_p
+    lib.spisniff_decoder_new.argtypes = []
+    lib.spisniff_decoder_free.restype = None
+    lib.spisniff_decoder_free.argtypes = [ctypes.c_void_p]
+    lib.spisniff_decode.restype = ctypes.c_size_t
+    lib.spisniff_decode.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_uint64,
+                                    ctypes.c_void_p, ctypes.c_size_t, size_t_p]
+
+    lib.spisniff_assembler_new.restype = ctypes.c_void_p
+    lib.spisniff_assembler_new.argtypes = [ctypes.c_uint64]
+    lib.spisniff_assembler_free.restype = None
+    lib.spisniff_assembler_free.argtypes = [ctypes.c_void_p]
+    lib.spisniff_assemble.restype = ctypes.c_size_t
+    lib.spisniff_assemble.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t,
+                                      ctypes.c_void_p, ctypes.c_size_t,
+                                      ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, size_t_p]
+
+    lib.spisniff_assembler_flush.restype = ctypes.c_size_t
+    lib.spisniff_assembler_flush.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t,
+                                             ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+    lib.spisniff_assembler_pending_bytes.restype = ctypes.c_size_t
+    lib.spisniff_assembler_pending_bytes.argtypes = [ctypes.c_void_p]
+
+    lib.spisniff_reader_open.restype = ctypes.c_void_p
+    lib.spisniff_reader_open.argtypes = [ctypes.c_char_p]
+    lib.spisniff_reader_close.restype = None
+    lib.spisniff_reader_close.argtypes = [ctypes.c_void_p]
+    lib.spisniff_reader_read.restype = ctypes.c_int64
+    lib.spisniff_reader_read.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+
+    version = lib.spisniff_abi_version()
+    if version < ABI_VERSION:
+        raise OSError(f"libspisniff ABI {version} is older than {ABI_VERSION} required here")
+    return lib
+
+
+_lib = _load_library()
+
+
+class Decoder:
+    """Streaming decoder for the raw UART byte stream. Records may be split
+    across calls at any byte boundary; timestamps are unwrapped to 64 bits."""
+
+    def __init__(self):
+        self._handle = _lib.spisniff_decoder_new()
+        if not self._handle:
+            raise MemoryError("spisniff_decoder_new failed")
+
+    def __del__(self):
+        if getattr(self, '_handle', None):
+            _lib.spisniff_decoder_free(self._handle)
+            self._handle = None
+
+    def decode(self, data, host_micros=0):
+        """Decodes any bytes-like object into a RECORD_DTYPE array."""
+        data = np.frombuffer(data, dtype=np.uint8)
+        # Room for the bytes of a record held back from the previous call too
+        out = np.empty(data.size // RECORD_SIZE + 1, dtype=RECORD_DTYPE)
+        consumed = ctypes.c_size_t()
+        count = _lib.spisniff_decode(self._handle, data.ctypes.data, data.size, host_micros,
+                                     out.ctypes.data, out.size, ctypes.byref(consumed))
+        if count == _ERROR:
+            raise MemoryError("spisniff_decode failed")
+        if consumed.value != data.size:
+            raise RuntimeError("spisniff_decode left input unconsumed")
+        return out[:count]
+
+
+class Assembler:
+    """Groups records into transactions. A transaction ends when SCLK stalls
+    for longer than gap_ticks (FPGA ticks, 5 ns each) or at a record with CS
+    high. The FPGA only writes records on SCLK edges, so the gap is what
+    normally ends a transaction; with gap_ticks=0 a whole capture is one."""
+
+    def __init__(self, gap_ticks=DEFAULT_GAP_TICKS):
+        self._handle = _lib.spisniff_assembler_new(gap_ticks)
+        if not self._handle:
+            raise MemoryError("spisniff_assembler_new failed")
+
+    def __del__(self):
+        if getattr(self, '_handle', None):
+            _lib.spisniff_assembler_free(self._handle)
+            self._handle = None
+
+    def _run(self, records, count):
+        transactions = []
+        mosi_parts = []
+        miso_parts = []
+        base = 0
+        offset = 0
+        # First guess; loop again if a burst of tiny transactions overflows it,
+        # and grow the payload arrays if a transaction (which may have started
+        # in an earlier call) does not fit
+        capacity = max(64, count // 8 + 1)
+        payload_capacity = max(4096, count // 8 + 64)
+
+        while True:
+            out = np.empty(capacity, dtype=TRANSACTION_DTYPE)
+            mosi = np.empty(payload_capacity, dtype=np.uint8)
+            miso = np.empty(payload_capacity, dtype=np.uint8)
+            if records is None:
+                written = _lib.spisniff_assembler_flush(self._handle, out.ctypes.data, out.size,
+                                                        mosi.ctypes.data, miso.ctypes.data, payload_capacity)
+            else:
+                consumed = ctypes.c_size_t()
+                remaining = count - offset
+                pointer = records.ctypes.data + offset * RECORD_DTYPE.itemsize
+                written = _lib.spisniff_assemble(self._handle, pointer, remaining,
+                                                 out.ctypes.data, out.size,
+                                                 mosi.ctypes.data, miso.ctypes.data, payload_capacity,
+                                                 ctypes.byref(consumed))
+                offset += consumed.value
+            if written == _ERROR:
+                raise MemoryError("spisniff_assemble failed")
+
+            if written:
+                out = out[:written]
+                used = int(out['payload_offset'][-1]) + (int(out['bits'][-1]) + 7) // 8
+                out['payload_offset'] += base
+                base += used
+                transactions.append(out)
+                mosi_parts.append(mosi[:used])
+                miso_parts.append(miso[:used])
+
+            # A transaction left waiting for room is picked up by the next round
+            pending = _lib.spisniff_assembler_pending_bytes(self._handle)
+            if pending > payload_capacity:
+                payload_capacity = max(pending, 2 * payload_capacity)
+                continue
+            if written == 0 and pending == 0 and (records is None or offset >= count):
+                break
+
+        if not transactions:
+            return (np.empty(0, dtype=TRANSACTION_DTYPE), np.empty(0, dtype=np.uint8),
+                    np.empty(0, dtype=np.uint8))
+        return np.concatenate(transactions), np.concatenate(mosi_parts), np.concatenate(miso_parts)
+
+    def assemble(self, records):
+        """Consumes a RECORD_DTYPE array. Returns (transactions, mosi, miso):
+        a TRANSACTION_DTYPE array and the packed payload bytes it indexes."""
+        records = np.ascontiguousarray(records, dtype=RECORD_DTYPE)
+        return self._run(records, records.size)
+
+    def flush(self):
+        """Returns the transaction still in progress, same shape as assemble()."""
+        return self._run(None, 0)
+
+
+def read_capture(path, chunk_records=1 << 20):
+    """Yields RECORD_DTYPE arrays of up to chunk_records from a pcap, pcapng or
+    raw dump file, so captures of any size can be processed in chunks."""
+    handle = _lib.spisniff_reader_open(os.fsencode(path))
+    if not handle:
+        raise OSError(f"could not open capture {path}")
+    try:
+        while True:
+            out = np.empty(chunk_records, dtype=RECORD_DTYPE)
+            count = _lib.spisniff_reader_read(handle, out.ctypes.data, out.size)
+            if count < 0:
+                raise OSError(f"error reading {path}")
+            if count == 0:
+                return
+            yield out[:count]
+    finally:
+        _lib.spisniff_reader_close(handle)
+
+
+def payload(transactions, data, index):
+    """Bytes of transaction `index` from the mosi or miso array returned by assemble()."""
+    t = transactions[index]
+    start = int(t['payload_offset'])
+    return data[start:start + (int(t['bits']) + 7) // 8]
+
+
+def pack_bits(bits):
+    """Packs a 0/1 array (e.g. records['mosi']) MSB first into bytes."""
+    return np.packbits(np.asarray(bits, dtype=np.uint8))
+
+
+def to_ascii(data):
+    """Printable ASCII with '.' for everything else, like the Lua dissector."""
+    data = np.asarray(data, dtype=np.uint8)
+    printable = np.where((data >= 32) & (data <= 126), data, ord('.')).astype(np.uint8)
+    return printable.tobytes().decode('ascii')
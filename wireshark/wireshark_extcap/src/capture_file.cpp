@@ -0,0 +1,278 @@
+#include "capture_file.hpp"
+#include "log.hpp"
+#include "output.hpp"
+#include "sequenced.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+static constexpr uint32_t PCAP_MAGIC_US      = 0xa1b2c3d4;
+static constexpr uint32_t PCAP_MAGIC_NS      = 0xa1b23c4d;
+static constexpr uint32_t PCAPNG_SHB         = 0x0A0D0D0A;
+static constexpr uint32_t PCAPNG_BYTE_ORDER  = 0x1A2B3C4D;
+static constexpr uint32_t PCAPNG_IDB         = 0x00000001;
+static constexpr uint32_t PCAPNG_SPB         = 0x00000003;
+static constexpr uint32_t PCAPNG_EPB         = 0x00000006;
+static constexpr size_t   RAW_CHUNK_SIZE     = 64 * 1024;
+static constexpr uint32_t MAX_BLOCK_SIZE     = 16 * 1024 * 1024;
+
+// Link types whose packets carry FPGA records
+static bool is_record_linktype(uint32_t linktype) {
+    return linktype == DLT_SPI_RECORDS || linktype == DLT_SPI_SEQUENCED;
+}
+
+CaptureReader::~CaptureReader() {
+    if (file_) {
+        fclose(file_);
+    }
+}
+
+uint32_t CaptureReader::swap32(uint32_t value) const {
+    return swapped_ ? __builtin_bswap32(value) : value;
+}
+
+uint16_t CaptureReader::swap16(uint16_t value) const {
+    return swapped_ ? __builtin_bswap16(value) : value;
+}
+
+bool CaptureReader::read_exact(void* dest, size_t len) {
+    if (len == 0) return true;
+    if (fread(dest, 1, len, file_) == len) return true;
+    if (ferror(file_)) {
+        LOG_ERROR("Read error in " << path_ << ": " << strerror(errno));
+        failed_ = true;
+    }
+    return false;
+}
+
+bool CaptureReader::open(const std::string& path) {
+    path_ = path;
+    file_ = fopen(path.c_str(), "rb");
+    if (!file_) {
+        LOG_ERROR("Could not open capture file: " << path << " - " << strerror(errno));
+        return false;
+    }
+    setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+
+    uint32_t magic = 0;
+    if (fread(&magic, 1, sizeof(magic), file_) != sizeof(magic)) {
+        // Shorter than any header, treat it as a (tiny) raw dump
+        rewind(file_);
+        format_ = Format::Raw;
+        return true;
+    }
+
+    if (magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS ||
+        magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS)) {
+        format_ = Format::Pcap;
+        swapped_ = (magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS));
+        nanosecond_ = (swap32(magic) == PCAP_MAGIC_NS);
+
+        uint8_t rest[20];
+        if (!read_exact(rest, sizeof(rest))) {
+            LOG_ERROR("Truncated pcap header in " << path);
+            return false;
+        }
+        uint32_t network;
+        std::memcpy(&network, rest + 16, sizeof(network));
+        linktype_ = swap32(network);
+        if (!is_record_linktype(linktype_)) {
+            LOG_ERROR(path << " has link type " << linktype_ << ", expected " << DLT_SPI_RECORDS
+                      << " (USER0) or " << DLT_SPI_SEQUENCED << " (USER2)");
+            return false;
+        }
+    } else if (magic == PCAPNG_SHB) {
+        // Byte order is only known once the section header is parsed, so the
+        // SHB is handled like every other block by next_pcapng_packet()
+        format_ = Format::Pcapng;
+        rewind(file_);
+    } else {
+        format_ = Format::Raw;
+        rewind(file_);
+    }
+
+    return true;
+}
+
+bool CaptureReader::next_pcap_packet() {
+    uint32_t header[4];
+    if (!read_exact(header, sizeof(header))) {
+        return false;
+    }
+
+    uint32_t ts_sec = swap32(header[0]);
+    uint32_t ts_frac = swap32(header[1]);
+    uint32_t incl_len = swap32(header[2]);
+    if (incl_len > MAX_BLOCK_SIZE) {
+        LOG_ERROR("Corrupt pcap record length " << incl_len << " in " << path_);
+        failed_ = true;
+        return false;
+    }
+
+    payload_.resize(incl_len);
+    if (!read_exact(payload_.data(), incl_len)) {
+        LOG_ERROR("Truncated pcap record in " << path_);
+        return false;
+    }
+    payload_micros_ = uint64_t(ts_sec) * 1000000 + (nanosecond_ ? ts_frac / 1000 : ts_frac);
+    payload_linktype_ = linktype_;
+    return true;
+}
+
+bool CaptureReader::next_pcapng_packet() {
+    while (true) {
+        uint32_t block_header[2];
+        if (!read_exact(block_header, sizeof(block_header))) {
+            return false;
+        }
+
+        uint32_t block_type = block_header[0];
+        uint32_t block_len = 0;
+
+        if (block_type == PCAPNG_SHB) {
+            uint32_t byte_order;
+            if (!read_exact(&byte_order, sizeof(byte_order))) return false;
+            swapped_ = (byte_order != PCAPNG_BYTE_ORDER);
+            // Interface ids restart with every section
+            interface_linktypes_.clear();
+            interface_tsresol_.clear();
+            block_len = swap32(block_header[1]);
+            if (block_len < 12 || block_len > MAX_BLOCK_SIZE) {
+                LOG_ERROR("Corrupt pcapng section header in " << path_);
+                failed_ = true;
+                return false;
+            }
+            payload_.resize(block_len - 12);
+            if (!read_exact(payload_.data(), payload_.size())) return false;
+            continue;
+        }
+
+        block_type = swap32(block_type);
+        block_len = swap32(block_header[1]);
+        if (block_len < 12 || block_len > MAX_BLOCK_SIZE || block_len % 4 != 0) {
+            LOG_ERROR("Corrupt pcapng block length " << block_len << " in " << path_);
+            failed_ = true;
+            return false;
+        }
+
+        // Block body without the two header words and the trailing length
+        std::vector<uint8_t>& body = payload_;
+        body.resize(block_len - 8);
+        if (!read_exact(body.data(), body.size())) return false;
+        size_t body_len = block_len - 12;
+
+        auto get32 = [&](size_t offset) {
+            uint32_t value;
+            std::memcpy(&value, body.data() + offset, sizeof(value));
+            return swap32(value);
+        };
+        auto get16 = [&](size_t offset) {
+            uint16_t value;
+            std::memcpy(&value, body.data() + offset, sizeof(value));
+            return swap16(value);
+        };
+
+        if (block_type == PCAPNG_IDB && body_len >= 8) {
+            interface_linktypes_.push_back(get16(0));
+
+            // Look for if_tsresol, default is microseconds
+            uint64_t tsresol = 1000000;
+            size_t offset = 8;
+            while (offset + 4 <= body_len) {
+                uint16_t code = get16(offset);
+                uint16_t len = get16(offset + 2);
+                if (code == 0) break;
+                if (code == 9 && len >= 1 && offset + 5 <= body_len) {
+                    uint8_t resol = body[offset + 4];
+                    uint8_t exponent = resol & 0x7F;
+                    tsresol = 1;
+                    for (uint8_t e = 0; e < exponent && tsresol < (uint64_t(1) << 60); ++e) {
+                        tsresol *= (resol & 0x80) ? 2 : 10;
+                    }
+                }
+                offset += 4 + ((len + 3) & ~3u);
+            }
+            interface_tsresol_.push_back(tsresol);
+            continue;
+        }
+
+        uint32_t interface_id = 0;
+        size_t data_offset = 0;
+        uint32_t captured = 0;
+        uint64_t ts = 0;
+
+        if (block_type == PCAPNG_EPB && body_len >= 20) {
+            interface_id = get32(0);
+            ts = (uint64_t(get32(4)) << 32) | get32(8);
+            captured = get32(12);
+            data_offset = 20;
+        } else if (block_type == PCAPNG_SPB && body_len >= 4) {
+            captured = std::min<uint32_t>(get32(0), body_len - 4);
+            data_offset = 4;
+        } else {
+            continue; // Not a packet block
+        }
+
+        if (interface_id >= interface_linktypes_.size() ||
+            !is_record_linktype(interface_linktypes_[interface_id]) ||
+            data_offset + captured > body_len) {
+            continue;
+        }
+
+        uint64_t tsresol = interface_tsresol_[interface_id];
+        payload_micros_ = static_cast<uint64_t>((unsigned __int128)ts * 1000000 / tsresol);
+        payload_linktype_ = interface_linktypes_[interface_id];
+
+        // Keep just the packet data at the front of the buffer
+        std::memmove(body.data(), body.data() + data_offset, captured);
+        body.resize(captured);
+        return true;
+    }
+}
+
+bool CaptureReader::next_packet() {
+    switch (format_) {
+        case Format::Pcap:
+            return next_pcap_packet();
+        case Format::Pcapng:
+            return next_pcapng_packet();
+        case Format::Raw:
+        default: {
+            payload_.resize(RAW_CHUNK_SIZE);
+            size_t got = fread(payload_.data(), 1, RAW_CHUNK_SIZE, file_);
+            if (got == 0) {
+                if (ferror(file_)) {
+                    LOG_ERROR("Read error in " << path_ << ": " << strerror(errno));
+                    failed_ = true;
+                }
+                return false;
+            }
+            payload_.resize(got);
+            payload_micros_ = 0;
+            payload_linktype_ = DLT_SPI_RECORDS;
+            return true;
+        }
+    }
+}
+
+bool CaptureReader::next(SpiRecord& record) {
+    while (decoded_pos_ == decoded_.size()) {
+        decoded_.clear();
+        decoded_pos_ = 0;
+        if (!next_packet()) {
+            return false;
+        }
+
+        // Sequenced packets hold exactly one record behind their header
+        size_t skip = 0;
+        if (payload_linktype_ == DLT_SPI_SEQUENCED) {
+            skip = std::min(payload_.size(), SEQUENCED_HEADER_SIZE);
+        }
+        framer_.feed(payload_.data() + skip, payload_.size() - skip, payload_micros_,
+                     [this](const SpiRecord& r) { decoded_.push_back(r); });
+    }
+
+    record = decoded_[decoded_pos_++];
+    return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "record.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Streams the records out of a saved capture in constant memory. Accepts:
+//   - pcap files written by the extcap (DLT 147 or 149, either byte order, us or ns)
+//   - pcapng files saved by Wireshark (packets from DLT 147 and 149 interfaces)
+//   - raw dumps, i.e. the UART byte stream as-is
+// The packet payloads are treated as one byte stream, since on DLT 147 the
+// extcap forwards UART reads as they arrive and these need not align with
+// records. The sequence/group header of DLT 149 packets is skipped.
+class CaptureReader {
+public:
+    enum class Format { Raw, Pcap, Pcapng };
+
+    CaptureReader() = default;
+    ~CaptureReader();
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+
+    bool open(const std::string& path);
+
+    // Returns false at end of file or on a read error (see failed())
+    bool next(SpiRecord& record);
+
+    Format format() const { return format_; }
+    bool failed() const { return failed_; }
+    uint64_t records() const { return framer_.records(); }
+    const std::string& path() const { return path_; }
+
+private:
+    // Loads the next packet payload into payload_; false at end of file
+    bool next_packet();
+    bool next_pcap_packet();
+    bool next_pcapng_packet();
+    bool read_exact(void* dest, size_t len);
+    uint32_t swap32(uint32_t value) const;
+    uint16_t swap16(uint16_t value) const;
+
+    std::string path_;
+    FILE* file_ = nullptr;
+    Format format_ = Format::Raw;
+    bool swapped_ = false;
+    bool nanosecond_ = false;
+    bool failed_ = false;
+    uint32_t linktype_ = 147;
+    std::vector<uint32_t> interface_linktypes_; // pcapng IDBs, by interface id
+    std::vector<uint64_t> interface_tsresol_;   // pcapng ticks per second
+
+    std::vector<uint8_t> payload_;
+    uint64_t payload_micros_ = 0;
+    uint32_t payload_linktype_ = 147;
+
+    std::vector<SpiRecord> decoded_;
+    size_t decoded_pos_ = 0;
+    RecordFramer framer_;
+};
@@ -0,0 +1,623 @@
+#include "export.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <zlib.h>
+
+// ---------------------------------------------------------------------------
+// Raw dump
+// ---------------------------------------------------------------------------
+
+RawWriter::~RawWriter() {
+    if (file_) {
+        fclose(file_);
+    }
+}
+
+bool RawWriter::open(const std::string& path) {
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_) {
+        LOG_ERROR("Could not create " << path << " - " << strerror(errno));
+        return false;
+    }
+    setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+    return true;
+}
+
+void RawWriter::write(const SpiRecord& record) {
+    uint8_t bytes[RECORD_SIZE];
+    encode_record(record, bytes);
+    fwrite(bytes, 1, sizeof(bytes), file_);
+}
+
+bool RawWriter::finish() {
+    bool ok = !ferror(file_);
+    ok = (fclose(file_) == 0) && ok;
+    file_ = nullptr;
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// VCD
+// ---------------------------------------------------------------------------
+
+// VCD identifiers, one printable character per signal
+static constexpr char VCD_MISO = '!';
+static constexpr char VCD_MOSI = '"';
+static constexpr char VCD_CS   = '#';
+static constexpr char VCD_SCLK = '$';
+static constexpr char VCD_FREQ = '%';
+
+VcdWriter::~VcdWriter() {
+    if (file_) {
+        fclose(file_);
+    }
+}
+
+bool VcdWriter::open(const std::string& path) {
+    file_ = fopen(path.c_str(), "w");
+    if (!file_) {
+        LOG_ERROR("Could not create " << path << " - " << strerror(errno));
+        return false;
+    }
+    setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+
+    char date[64];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+    fprintf(file_, "$date %s $end\n", date);
+    fprintf(file_, "$version FPGA SPI sniffer $end\n");
+    fprintf(file_, "$timescale 1 ns $end\n");
+    fprintf(file_, "$scope module spi $end\n");
+    fprintf(file_, "$var wire 1 %c miso $end\n", VCD_MISO);
+    fprintf(file_, "$var wire 1 %c mosi $end\n", VCD_MOSI);
+    fprintf(file_, "$var wire 1 %c cs $end\n", VCD_CS);
+    fprintf(file_, "$var wire 1 %c sclk $end\n", VCD_SCLK);
+    fprintf(file_, "$var wire 13 %c sclk_freq $end\n", VCD_FREQ);
+    fprintf(file_, "$upscope $end\n");
+    fprintf(file_, "$enddefinitions $end\n");
+    return true;
+}
+
+static void vcd_write_vector(FILE* file, uint16_t value, char id) {
+    char bits[14];
+    int n = 0;
+    // Leading zeros may be dropped in VCD vectors
+    for (int bit = 12; bit >= 0; --bit) {
+        if (n == 0 && bit > 0 && !((value >> bit) & 1)) continue;
+        bits[n++] = ((value >> bit) & 1) ? '1' : '0';
+    }
+    bits[n] = '\0';
+    fprintf(file, "b%s %c\n", bits, id);
+}
+
+void VcdWriter::change_at(uint64_t ticks, const State& next) {
+    uint64_t time_ns = (ticks - origin_) * NS_PER_TICK;
+
+    bool first = !time_written_;
+    if (first) {
+        fprintf(file_, "#%llu\n$dumpvars\n", (unsigned long long)time_ns);
+        fprintf(file_, "%c%c\n", next.miso ? '1' : '0', VCD_MISO);
+        fprintf(file_, "%c%c\n", next.mosi ? '1' : '0', VCD_MOSI);
+        fprintf(file_, "%c%c\n", next.cs ? '1' : '0', VCD_CS);
+        fprintf(file_, "%c%c\n", next.sclk ? '1' : '0', VCD_SCLK);
+        vcd_write_vector(file_, next.sclk_freq, VCD_FREQ);
+        fprintf(file_, "$end\n");
+        time_written_ = true;
+        last_time_ = time_ns;
+        state_ = next;
+        return;
+    }
+
+    bool time_pending = (time_ns != last_time_);
+    auto stamp = [&]() {
+        if (time_pending) {
+            fprintf(file_, "#%llu\n", (unsigned long long)time_ns);
+            last_time_ = time_ns;
+            time_pending = false;
+        }
+    };
+
+    if (next.miso != state_.miso) { stamp(); fprintf(file_, "%c%c\n", next.miso ? '1' : '0', VCD_MISO); }
+    if (next.mosi != state_.mosi) { stamp(); fprintf(file_, "%c%c\n", next.mosi ? '1' : '0', VCD_MOSI); }
+    if (next.cs != state_.cs)     { stamp(); fprintf(file_, "%c%c\n", next.cs ? '1' : '0', VCD_CS); }
+    if (next.sclk != state_.sclk) { stamp(); fprintf(file_, "%c%c\n", next.sclk ? '1' : '0', VCD_SCLK); }
+    if (next.sclk_freq != state_.sclk_freq) { stamp(); vcd_write_vector(file_, next.sclk_freq, VCD_FREQ); }
+
+    state_ = next;
+}
+
+void VcdWriter::write(const SpiRecord& record) {
+    if (!started_) {
+        started_ = true;
+        origin_ = record.timestamp;
+    }
+
+    sclk_.next(record, [&](uint64_t ticks, bool sclk) {
+        State next = state_;
+        next.sclk = sclk;
+        if (!sclk) {
+            // Falling edge: this is where the record was sampled
+            next.miso = record.miso;
+            next.mosi = record.mosi;
+            next.cs = record.cs;
+            next.sclk_freq = record.sclk_freq;
+        }
+        change_at(ticks, next);
+    });
+}
+
+bool VcdWriter::finish() {
+    sclk_.flush([&](uint64_t ticks, bool sclk) {
+        State next = state_;
+        next.sclk = sclk;
+        change_at(ticks, next);
+    });
+
+    bool ok = !ferror(file_);
+    ok = (fclose(file_) == 0) && ok;
+    file_ = nullptr;
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// sigrok session
+// ---------------------------------------------------------------------------
+
+// Samples per logic-1-N chunk file, the same size sigrok itself writes
+static constexpr size_t SIGROK_CHUNK_SAMPLES = 4 * 1024 * 1024;
+
+// Logic channel bits within a sample byte
+static constexpr uint8_t SR_MISO = 0x01;
+static constexpr uint8_t SR_MOSI = 0x02;
+static constexpr uint8_t SR_CS   = 0x04;
+static constexpr uint8_t SR_SCLK = 0x08;
+
+static void put16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(value & 0xFF);
+    out.push_back(value >> 8);
+}
+
+static void put32(std::vector<uint8_t>& out, uint32_t value) {
+    put16(out, value & 0xFFFF);
+    put16(out, value >> 16);
+}
+
+static void put64(std::vector<uint8_t>& out, uint64_t value) {
+    put32(out, value & 0xFFFFFFFF);
+    put32(out, value >> 32);
+}
+
+SigrokWriter::SigrokWriter(uint64_t samplerate, uint64_t max_idle_ticks)
+    : samplerate_(samplerate), max_idle_ticks_(max_idle_ticks) {}
+
+SigrokWriter::~SigrokWriter() {
+    if (file_) {
+        fclose(file_);
+    }
+}
+
+bool SigrokWriter::open(const std::string& path) {
+    if (samplerate_ == 0 || samplerate_ > FPGA_CLOCK_HZ) {
+        LOG_ERROR("sigrok samplerate must be between 1 Hz and " << FPGA_CLOCK_HZ << " Hz");
+        return false;
+    }
+
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_) {
+        LOG_ERROR("Could not create " << path << " - " << strerror(errno));
+        return false;
+    }
+    setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+
+    chunk_.reserve(SIGROK_CHUNK_SAMPLES);
+    compressed_.reserve(compressBound(SIGROK_CHUNK_SAMPLES));
+
+    const char version[] = "2";
+    return add_entry("version", reinterpret_cast<const uint8_t*>(version), 1, false);
+}
+
+// Sample number of a value change at `ticks`. Changes come in time order;
+// idle time past max_idle_ticks_ since the previous one is cut out.
+uint64_t SigrokWriter::sample_index(uint64_t ticks) {
+    if (max_idle_ticks_ != 0 && ticks - last_change_ > max_idle_ticks_) {
+        skipped_ticks_ += ticks - last_change_ - max_idle_ticks_;
+        shortened_gaps_++;
+    }
+    last_change_ = ticks;
+    return static_cast<uint64_t>((unsigned __int128)(ticks - origin_ - skipped_ticks_) * samplerate_ / FPGA_CLOCK_HZ);
+}
+
+// Repeats the current sample value up to (not including) `sample`
+void SigrokWriter::fill_until(uint64_t sample) {
+    while (next_sample_ < sample) {
+        if (chunk_.empty() && sample - next_sample_ >= SIGROK_CHUNK_SAMPLES) {
+            add_constant_chunk();
+            next_sample_ += SIGROK_CHUNK_SAMPLES;
+            continue;
+        }
+        size_t room = SIGROK_CHUNK_SAMPLES - chunk_.size();
+        size_t count = std::min<uint64_t>(room, sample - next_sample_);
+        chunk_.insert(chunk_.end(), count, current_);
+        next_sample_ += count;
+        if (chunk_.size() == SIGROK_CHUNK_SAMPLES) {
+            flush_chunk();
+        }
+    }
+}
+
+void SigrokWriter::flush_chunk() {
+    if (chunk_.empty()) return;
+    std::string name = "logic-1-" + std::to_string(++chunk_number_);
+    add_entry(name, chunk_.data(), chunk_.size(), true);
+    chunk_.clear();
+}
+
+// Writes a whole chunk of the current value, deflating it only when the
+// value differs from the last constant chunk
+bool SigrokWriter::add_constant_chunk() {
+    if (!ok_) return false;
+
+    if (!constant_valid_ || constant_value_ != current_) {
+        chunk_.assign(SIGROK_CHUNK_SAMPLES, current_);
+        constant_crc_ = crc32(0L, chunk_.data(), chunk_.size());
+        bool deflated = deflate_chunk(chunk_.data(), chunk_.size(), constant_compressed_);
+        chunk_.clear();
+        if (!deflated) {
+            ok_ = false;
+            return false;
+        }
+        constant_valid_ = true;
+        constant_value_ = current_;
+    }
+
+    ZipEntry entry;
+    entry.name = "logic-1-" + std::to_string(++chunk_number_);
+    entry.method = 8;
+    entry.crc = constant_crc_;
+    entry.size = SIGROK_CHUNK_SAMPLES;
+    entry.compressed_size = constant_compressed_.size();
+    return write_entry(std::move(entry), constant_compressed_.data());
+}
+
+void SigrokWriter::write(const SpiRecord& record) {
+    if (!started_) {
+        started_ = true;
+        origin_ = record.timestamp;
+        last_change_ = record.timestamp;
+    }
+
+    sclk_.next(record, [&](uint64_t ticks, bool sclk) {
+        fill_until(sample_index(ticks));
+        uint8_t next = current_;
+        if (sclk) {
+            next |= SR_SCLK;
+        } else {
+            next = (record.miso ? SR_MISO : 0) | (record.mosi ? SR_MOSI : 0) | (record.cs ? SR_CS : 0);
+        }
+        current_ = next;
+    });
+}
+
+// Raw deflate stream, as zip expects (no zlib header)
+bool SigrokWriter::deflate_chunk(const uint8_t* data, size_t len, std::vector<uint8_t>& out) {
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        LOG_ERROR("deflateInit2() failed");
+        return false;
+    }
+    out.resize(compressBound(len));
+    stream.next_in = const_cast<Bytef*>(data);
+    stream.avail_in = len;
+    stream.next_out = out.data();
+    stream.avail_out = out.size();
+    int result = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END) {
+        LOG_ERROR("deflate() failed");
+        return false;
+    }
+    return true;
+}
+
+bool SigrokWriter::add_entry(const std::string& name, const uint8_t* data, size_t len, bool compress) {
+    if (!ok_) return false;
+
+    ZipEntry entry;
+    entry.name = name;
+    entry.method = compress ? 8 : 0;
+    entry.crc = crc32(0L, data, len);
+    entry.size = len;
+    entry.compressed_size = len;
+
+    const uint8_t* payload = data;
+    if (compress) {
+        if (!deflate_chunk(data, len, compressed_)) {
+            ok_ = false;
+            return false;
+        }
+        payload = compressed_.data();
+        entry.compressed_size = compressed_.size();
+    }
+    return write_entry(std::move(entry), payload);
+}
+
+bool SigrokWriter::write_entry(ZipEntry entry, const uint8_t* payload) {
+    if (!ok_) return false;
+    entry.offset = offset_;
+
+    std::vector<uint8_t> header;
+    put32(header, 0x04034b50);        // local file header signature
+    put16(header, 20);                // version needed to extract
+    put16(header, 0);                 // flags
+    put16(header, entry.method);
+    put16(header, 0);                 // mod time
+    put16(header, 0x21);              // mod date (1980-01-01)
+    put32(header, entry.crc);
+    put32(header, entry.compressed_size);
+    put32(header, entry.size);
+    put16(header, entry.name.size());
+    put16(header, 0);                 // extra field length
+    header.insert(header.end(), entry.name.begin(), entry.name.end());
+
+    if (fwrite(header.data(), 1, header.size(), file_) != header.size() ||
+        fwrite(payload, 1, entry.compressed_size, file_) != entry.compressed_size) {
+        LOG_ERROR("Write to sigrok file failed: " << strerror(errno));
+        ok_ = false;
+        return false;
+    }
+
+    offset_ += header.size() + entry.compressed_size;
+    entries_.push_back(std::move(entry));
+    return true;
+}
+
+bool SigrokWriter::write_central_directory() {
+    uint64_t directory_offset = offset_;
+    std::vector<uint8_t> directory;
+
+    for (const ZipEntry& entry : entries_) {
+        bool zip64 = entry.offset >= 0xFFFFFFFF;
+        put32(directory, 0x02014b50);  // central directory header signature
+        put16(directory, zip64 ? 45 : 20); // version made by
+        put16(directory, zip64 ? 45 : 20); // version needed to extract
+        put16(directory, 0);
+        put16(directory, entry.method);
+        put16(directory, 0);
+        put16(directory, 0x21);
+        put32(directory, entry.crc);
+        put32(directory, entry.compressed_size);
+        put32(directory, entry.size);
+        put16(directory, entry.name.size());
+        put16(directory, zip64 ? 12 : 0); // extra field length
+        put16(directory, 0);           // comment length
+        put16(directory, 0);           // disk number start
+        put16(directory, 0);           // internal attributes
+        put32(directory, 0);           // external attributes
+        put32(directory, zip64 ? 0xFFFFFFFF : entry.offset);
+        directory.insert(directory.end(), entry.name.begin(), entry.name.end());
+        if (zip64) {
+            put16(directory, 0x0001);  // zip64 extended information
+            put16(directory, 8);
+            put64(directory, entry.offset);
+        }
+    }
+
+    uint64_t directory_size = directory.size();
+    uint64_t count = entries_.size();
+    bool zip64 = count >= 0xFFFF || directory_offset >= 0xFFFFFFFF || directory_size >= 0xFFFFFFFF;
+
+    if (zip64) {
+        uint64_t record_offset = directory_offset + directory_size;
+        put32(directory, 0x06064b50);  // zip64 end of central directory record
+        put64(directory, 44);
+        put16(directory, 45);
+        put16(directory, 45);
+        put32(directory, 0);
+        put32(directory, 0);
+        put64(directory, count);
+        put64(directory, count);
+        put64(directory, directory_size);
+        put64(directory, directory_offset);
+
+        put32(directory, 0x07064b50);  // zip64 end of central directory locator
+        put32(directory, 0);
+        put64(directory, record_offset);
+        put32(directory, 1);
+    }
+
+    put32(directory, 0x06054b50);      // end of central directory record
+    put16(directory, 0);
+    put16(directory, 0);
+    put16(directory, zip64 ? 0xFFFF : count);
+    put16(directory, zip64 ? 0xFFFF : count);
+    put32(directory, zip64 ? 0xFFFFFFFF : directory_size);
+    put32(directory, zip64 ? 0xFFFFFFFF : directory_offset);
+    put16(directory, 0);
+
+    return fwrite(directory.data(), 1, directory.size(), file_) == directory.size();
+}
+
+// Same notation sigrok uses itself, e.g. "50 MHz"
+static std::string samplerate_string(uint64_t samplerate) {
+    if (samplerate % 1000000000 == 0) return std::to_string(samplerate / 1000000000) + " GHz";
+    if (samplerate % 1000000 == 0) return std::to_string(samplerate / 1000000) + " MHz";
+    if (samplerate % 1000 == 0) return std::to_string(samplerate / 1000) + " kHz";
+    return std::to_string(samplerate) + " Hz";
+}
+
+bool SigrokWriter::finish() {
+    sclk_.flush([&](uint64_t ticks, bool sclk) {
+        fill_until(sample_index(ticks));
+        if (sclk) current_ |= SR_SCLK;
+    });
+    // The last state is held for one sample so it is visible at all
+    if (started_) {
+        fill_until(next_sample_ + 1);
+    }
+    flush_chunk();
+    if (shortened_gaps_ != 0) {
+        LOG_INFO("sigrok output: " << shortened_gaps_ << " idle periods shortened to "
+                 << max_idle_ticks_ / (FPGA_CLOCK_HZ / 1000) << " ms, "
+                 << skipped_ticks_ / (FPGA_CLOCK_HZ / 1000) << " ms skipped in total");
+    }
+
+    std::string metadata =
+        "[global]\n"
+        "sigrok version=0.5.2\n"
+        "\n"
+        "[device 1]\n"
+        "capturefile=logic-1\n"
+        "total probes=4\n"
+        "samplerate=" + samplerate_string(samplerate_) + "\n"
+        "total analog=0\n"
+        "probe1=MISO\n"
+        "probe2=MOSI\n"
+        "probe3=CS\n"
+        "probe4=SCLK\n"
+        "unitsize=1\n";
+    // sigrok ignores sections it does not know; this one says how far the
+    // sample timeline is from the FPGA one
+    if (max_idle_ticks_ != 0) {
+        metadata +=
+            "\n"
+            "[spi sniffer]\n"
+            "max idle ms=" + std::to_string(max_idle_ticks_ / (FPGA_CLOCK_HZ / 1000)) + "\n"
+            "shortened idle periods=" + std::to_string(shortened_gaps_) + "\n"
+            "skipped idle ns=" + std::to_string(skipped_ticks_ * NS_PER_TICK) + "\n";
+    }
+    add_entry("metadata", reinterpret_cast<const uint8_t*>(metadata.data()), metadata.size(), false);
+
+    bool ok = ok_ && write_central_directory() && !ferror(file_);
+    ok = (fclose(file_) == 0) && ok;
+    file_ = nullptr;
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Record-to-disk
+// ---------------------------------------------------------------------------
+
+// Records per batch handed to the writer thread, and batches it may lag behind
+static constexpr size_t RECORDER_BATCH_RECORDS = 4096;
+static constexpr size_t RECORDER_QUEUE_BATCHES = 1024;
+// A partly filled batch is handed over after this long, so a quiet bus still
+// reaches the file
+static constexpr uint64_t RECORDER_BATCH_US = 100000;
+
+DiskRecorder::~DiskRecorder() {
+    if (writer_.joinable()) {
+        finish();
+    }
+}
+
+bool DiskRecorder::open(const std::string& path, const std::string& format, uint64_t samplerate,
+                        uint64_t max_idle_ticks) {
+    sink_ = make_record_sink(format, samplerate, max_idle_ticks);
+    if (!sink_) {
+        LOG_ERROR("Unknown record format: " << format);
+        return false;
+    }
+    if (!sink_->open(path)) {
+        sink_.reset();
+        return false;
+    }
+    batch_.reserve(RECORDER_BATCH_RECORDS);
+    writer_ = std::thread(&DiskRecorder::writer_loop, this);
+    return true;
+}
+
+void DiskRecorder::feed(const uint8_t* data, size_t len, uint64_t host_micros) {
+    if (batch_.empty()) {
+        batch_micros_ = host_micros;
+    }
+    framer_.feed(data, len, host_micros, [this](const SpiRecord& record) {
+        batch_.push_back(record);
+        if (batch_.size() == RECORDER_BATCH_RECORDS) {
+            push_batch();
+        }
+    });
+    if (!batch_.empty() && host_micros - batch_micros_ >= RECORDER_BATCH_US) {
+        push_batch();
+    }
+}
+
+void DiskRecorder::push_batch() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.size() < RECORDER_QUEUE_BATCHES) {
+            queue_.push_back(std::move(batch_));
+            ready_.notify_one();
+        } else {
+            dropped_ += batch_.size();
+        }
+    }
+    batch_ = std::vector<SpiRecord>();
+    batch_.reserve(RECORDER_BATCH_RECORDS);
+}
+
+// Function run by the writer thread
+void DiskRecorder::writer_loop() {
+    std::vector<SpiRecord> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [this] { return !queue_.empty() || closing_; });
+            if (queue_.empty()) {
+                return;
+            }
+            batch = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        for (const SpiRecord& record : batch) {
+            sink_->write(record);
+        }
+    }
+}
+
+bool DiskRecorder::finish() {
+    if (!batch_.empty()) {
+        push_batch();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+        ready_.notify_one();
+    }
+    writer_.join();
+
+    if (dropped_ != 0) {
+        LOG_ERROR("Recording fell behind, " << dropped_ << " records were not written");
+    }
+    bool ok = sink_->finish() && dropped_ == 0;
+    sink_.reset();
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Factory
+// ---------------------------------------------------------------------------
+
+std::unique_ptr<RecordSink> make_record_sink(const std::string& format, uint64_t samplerate,
+                                             uint64_t max_idle_ticks) {
+    if (format == "raw") return std::make_unique<RawWriter>();
+    if (format == "vcd") return std::make_unique<VcdWriter>();
+    if (format == "sr")  return std::make_unique<SigrokWriter>(samplerate, max_idle_ticks);
+    return nullptr;
+}
+
+std::string export_format_for_path(const std::string& path) {
+    auto ends_with = [&](const char* suffix) {
+        size_t n = std::strlen(suffix);
+        return path.size() >= n && path.compare(path.size() - n, n, suffix) == 0;
+    };
+    if (ends_with(".vcd")) return "vcd";
+    if (ends_with(".sr")) return "sr";
+    return "raw";
+}
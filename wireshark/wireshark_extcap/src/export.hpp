@@ -0,0 +1,209 @@
+#pragma once
+
+#include "record.hpp"
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Longest idle period kept in sigrok output by default, 0 = no limit. Cutting
+// idle time keeps file size down on sparse buses, but moves the timeline away
+// from the FPGA counter, so it is only done when asked for.
+constexpr uint64_t DEFAULT_SIGROK_MAX_IDLE_MS = 0;
+
+// Destination for a stream of decoded records. Writers keep only the state
+// needed for the next value change, so output runs in constant memory.
+class RecordSink {
+public:
+    virtual ~RecordSink() = default;
+    virtual bool open(const std::string& path) = 0;
+    virtual void write(const SpiRecord& record) = 0;
+    // Flushes pending changes and closes the file; false if anything failed
+    virtual bool finish() = 0;
+};
+
+// The UART byte stream as-is, 6 bytes per record
+class RawWriter : public RecordSink {
+public:
+    ~RawWriter() override;
+    bool open(const std::string& path) override;
+    void write(const SpiRecord& record) override;
+    bool finish() override;
+
+private:
+    FILE* file_ = nullptr;
+};
+
+// SCLK is not captured directly, only its falling edges (one per record) and
+// its measured frequency. Both waveform writers rebuild it from those: low at
+// each record, high again half a period later (or halfway to the next record
+// when that comes first or the frequency is unknown).
+class SclkReconstructor {
+public:
+    // Calls change(time, sclk) for every edge up to and including `record`
+    template <typename Change>
+    void next(const SpiRecord& record, Change&& change) {
+        if (have_previous_) {
+            uint64_t rise = previous_ + (record.timestamp - previous_) / 2;
+            if (previous_half_period_ != 0 && previous_ + previous_half_period_ < rise) {
+                rise = previous_ + previous_half_period_;
+            }
+            if (rise > previous_) {
+                change(rise, true);
+            }
+        }
+        change(record.timestamp, false);
+
+        have_previous_ = true;
+        previous_ = record.timestamp;
+        previous_half_period_ = sclk_half_period_ticks(record.sclk_freq);
+    }
+
+    // Emits the rising edge after the final record, if its frequency is known
+    template <typename Change>
+    void flush(Change&& change) {
+        if (have_previous_ && previous_half_period_ != 0) {
+            change(previous_ + previous_half_period_, true);
+        }
+        have_previous_ = false;
+    }
+
+private:
+    bool have_previous_ = false;
+    uint64_t previous_ = 0;
+    uint64_t previous_half_period_ = 0;
+};
+
+// Value Change Dump for GTKWave and friends. Timestamps are the unwrapped FPGA
+// counter in ns relative to the first record; a value is only written when it
+// changes, so file size follows bus activity rather than capture length.
+class VcdWriter : public RecordSink {
+public:
+    ~VcdWriter() override;
+    bool open(const std::string& path) override;
+    void write(const SpiRecord& record) override;
+    bool finish() override;
+
+private:
+    struct State {
+        bool miso, mosi, cs, sclk;
+        uint16_t sclk_freq;
+    };
+
+    void change_at(uint64_t ticks, const State& next);
+
+    FILE* file_ = nullptr;
+    bool started_ = false;
+    uint64_t origin_ = 0;
+    uint64_t last_time_ = 0;
+    bool time_written_ = false;
+    State state_ = {};
+    SclkReconstructor sclk_;
+};
+
+// sigrok session file (.sr, a zip archive) for PulseView / sigrok-cli. Logic
+// data is uniformly sampled, so the record stream is resampled at
+// `samplerate` and written in fixed size deflated chunks. Idle periods longer
+// than `max_idle_ticks` (0 = no limit) are shortened to it, and chunks holding
+// a single value are deflated once and reused, so idle time costs neither CPU
+// nor much disk.
+class SigrokWriter : public RecordSink {
+public:
+    SigrokWriter(uint64_t samplerate, uint64_t max_idle_ticks);
+    ~SigrokWriter() override;
+    bool open(const std::string& path) override;
+    void write(const SpiRecord& record) override;
+    bool finish() override;
+
+private:
+    struct ZipEntry {
+        std::string name;
+        uint16_t method;
+        uint32_t crc;
+        uint64_t compressed_size;
+        uint64_t size;
+        uint64_t offset;
+    };
+
+    uint64_t sample_index(uint64_t ticks);
+    void fill_until(uint64_t sample);
+    void flush_chunk();
+    bool add_constant_chunk();
+    bool deflate_chunk(const uint8_t* data, size_t len, std::vector<uint8_t>& out);
+    bool add_entry(const std::string& name, const uint8_t* data, size_t len, bool compress);
+    bool write_entry(ZipEntry entry, const uint8_t* payload);
+    bool write_central_directory();
+
+    uint64_t samplerate_;
+    uint64_t max_idle_ticks_;
+    FILE* file_ = nullptr;
+    bool ok_ = true;
+    uint64_t offset_ = 0;
+    std::vector<ZipEntry> entries_;
+
+    bool started_ = false;
+    uint64_t origin_ = 0;
+    uint64_t last_change_ = 0;   // FPGA ticks of the previous value change
+    uint64_t skipped_ticks_ = 0; // idle time cut out so far
+    uint64_t shortened_gaps_ = 0;
+    uint64_t next_sample_ = 0;
+    uint8_t current_ = 0;
+    std::vector<uint8_t> chunk_;
+    std::vector<uint8_t> compressed_;
+    int chunk_number_ = 0;
+    SclkReconstructor sclk_;
+
+    // Deflated full chunk of one repeated value, reused for idle periods
+    bool constant_valid_ = false;
+    uint8_t constant_value_ = 0;
+    uint32_t constant_crc_ = 0;
+    std::vector<uint8_t> constant_compressed_;
+};
+
+// Record-to-disk tap for the live capture: frames the UART chunks into
+// records and hands them in batches to a writer thread, so file output never
+// stalls the capture loop. feed() does not block; if the writer falls more
+// than RECORDER_QUEUE_BATCHES behind, batches are dropped and counted.
+class DiskRecorder {
+public:
+    ~DiskRecorder();
+
+    bool open(const std::string& path, const std::string& format, uint64_t samplerate,
+              uint64_t max_idle_ticks = DEFAULT_SIGROK_MAX_IDLE_MS * (FPGA_CLOCK_HZ / 1000));
+    void feed(const uint8_t* data, size_t len, uint64_t host_micros);
+    // Writes what is still queued and closes the file
+    bool finish();
+
+    // Records written to the file, and records lost because the writer lagged
+    uint64_t records() const { return framer_.records() - dropped_; }
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    void push_batch();
+    void writer_loop();
+
+    std::unique_ptr<RecordSink> sink_;
+    RecordFramer framer_;
+    std::vector<SpiRecord> batch_;
+    uint64_t batch_micros_ = 0; // host time the current batch was started
+    uint64_t dropped_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::vector<SpiRecord>> queue_;
+    bool closing_ = false;
+    std::thread writer_;
+};
+
+// Builds a writer for "raw", "vcd" or "sr"; nullptr for an unknown format.
+// `samplerate` and `max_idle_ticks` only apply to sigrok output.
+std::unique_ptr<RecordSink> make_record_sink(const std::string& format, uint64_t samplerate,
+                                             uint64_t max_idle_ticks = 0);
+
+// Picks the export format from a file name extension ("raw" if unknown)
+std::string export_format_for_path(const std::string& path);
@@ -0,0 +1,256 @@
+#include "latency.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+// ---------------------------------------------------------------------------
+// Histogram
+// ---------------------------------------------------------------------------
+
+size_t LatencyHistogram::bucket_index(uint64_t ticks) {
+    if (ticks < 2 * SUB_BUCKETS) {
+        return ticks;
+    }
+    int msb = 63 - __builtin_clzll(ticks);
+    if (msb >= MAX_BITS) {
+        return NUM_BUCKETS - 1;
+    }
+    int shift = msb - SUB_BUCKET_BITS;
+    uint64_t sub = (ticks >> shift) - SUB_BUCKETS;
+    return 2 * SUB_BUCKETS + (msb - SUB_BUCKET_BITS - 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucket_upper(size_t index) {
+    if (index < 2 * SUB_BUCKETS) {
+        return index;
+    }
+    size_t offset = index - 2 * SUB_BUCKETS;
+    int shift = offset / SUB_BUCKETS + 1;
+    uint64_t sub = offset % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::add(uint64_t ticks) {
+    buckets_[bucket_index(ticks)]++;
+    count_++;
+    sum_ += ticks;
+    if (ticks < min_) min_ = ticks;
+    if (ticks > max_) max_ = ticks;
+}
+
+uint64_t LatencyHistogram::percentile(double quantile) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    uint64_t target = std::max<uint64_t>(1, uint64_t(std::ceil(quantile * count_)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        seen += buckets_[i];
+        if (seen >= target) {
+            return std::max(min_, std::min(bucket_upper(i), max_));
+        }
+    }
+    return max_;
+}
+
+// ---------------------------------------------------------------------------
+// Profiler
+// ---------------------------------------------------------------------------
+
+void LatencyProfiler::add(const SpiRecord& record) {
+    if (record.cs) {
+        if (active_) {
+            finish_transaction();
+        }
+        return;
+    }
+
+    if (active_ && options_.gap_ticks != 0 && record.timestamp - end_ > options_.gap_ticks) {
+        finish_transaction();
+    }
+
+    if (!active_) {
+        active_ = true;
+        start_ = record.timestamp;
+        bits_ = 0;
+        responded_ = false;
+    }
+
+    mosi_byte_ = uint8_t((mosi_byte_ << 1) | record.mosi);
+    miso_byte_ = uint8_t((miso_byte_ << 1) | record.miso);
+    end_ = record.timestamp;
+    end_half_period_ = sclk_half_period_ticks(record.sclk_freq);
+    bits_++;
+
+    if (bits_ % 8 != 0) {
+        return;
+    }
+    if (bits_ == 8) {
+        command_ = mosi_byte_ & options_.key_mask;
+        command_end_ = record.timestamp;
+    } else if (!responded_ && miso_byte_ != options_.idle_miso) {
+        // Any value is an answer (0x00 and 0xFF are valid register data)
+        // unless an idle pattern was configured
+        responded_ = true;
+        turnaround_ = record.timestamp - command_end_;
+    }
+}
+
+void LatencyProfiler::flush() {
+    if (active_) {
+        finish_transaction();
+    }
+}
+
+void LatencyProfiler::finish_transaction() {
+    active_ = false;
+    transactions_++;
+
+    if (bits_ < 8) {
+        short_transactions_++;
+    } else {
+        std::unique_ptr<KeyLatency>& key = keys_[command_];
+        if (!key) {
+            key = std::make_unique<KeyLatency>();
+        }
+        // Records are falling edges; the last bit ends at the rising edge after it
+        key->duration.add(end_ - start_ + end_half_period_);
+        if (has_previous_) {
+            key->interval.add(start_ - previous_start_);
+        }
+        if (responded_) {
+            key->turnaround.add(turnaround_);
+        } else {
+            key->no_response++;
+        }
+    }
+
+    has_previous_ = true;
+    previous_start_ = start_;
+}
+
+static double ticks_to_us(uint64_t ticks) {
+    return double(ticks) * NS_PER_TICK / 1000.0;
+}
+
+static void format_histogram(std::ostringstream& out, const char* name, const LatencyHistogram& histogram) {
+    char line[200];
+    if (histogram.count() == 0) {
+        snprintf(line, sizeof(line), "  %-11s %10d\n", name, 0);
+    } else {
+        snprintf(line, sizeof(line), "  %-11s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n", name,
+                 (unsigned long long)histogram.count(), ticks_to_us(histogram.min()),
+                 ticks_to_us(histogram.percentile(0.5)), ticks_to_us(histogram.percentile(0.9)),
+                 ticks_to_us(histogram.percentile(0.99)), ticks_to_us(histogram.percentile(0.999)),
+                 ticks_to_us(histogram.max()), histogram.mean() * NS_PER_TICK / 1000.0);
+    }
+    out << line;
+}
+
+std::string LatencyProfiler::report() const {
+    std::ostringstream out;
+    char line[200];
+    snprintf(line, sizeof(line), "Latency profile: %llu transactions (%llu shorter than a byte), key = first MOSI byte & 0x%02X\n",
+             (unsigned long long)transactions_, (unsigned long long)short_transactions_, options_.key_mask);
+    out << line;
+
+    for (int command = 0; command < 256; ++command) {
+        const KeyLatency* key = keys_[command].get();
+        if (!key) continue;
+
+        snprintf(line, sizeof(line), "key 0x%02X: %llu transactions, %llu without response\n", command,
+                 (unsigned long long)key->duration.count(), (unsigned long long)key->no_response);
+        out << line;
+        snprintf(line, sizeof(line), "  %-11s %10s %10s %10s %10s %10s %10s %10s %10s\n", "(us)", "count", "min",
+                 "p50", "p90", "p99", "p99.9", "max", "mean");
+        out << line;
+        format_histogram(out, "duration", key->duration);
+        format_histogram(out, "interval", key->interval);
+        format_histogram(out, "turnaround", key->turnaround);
+    }
+    return out.str();
+}
+
+// ---------------------------------------------------------------------------
+// Capture output
+// ---------------------------------------------------------------------------
+
+volatile std::sig_atomic_t g_latency_dump_requested = 0;
+
+static void handle_dump_signal(int) {
+    g_latency_dump_requested = 1;
+}
+
+void install_latency_dump_handler() {
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_dump_signal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, nullptr);
+}
+
+bool ProfilingOutput::feed(int fd_fifo, const uint8_t* data, size_t len, uint64_t micros) {
+    framer_.feed(data, len, micros, [this](const SpiRecord& record) { profiler_.add(record); });
+    dump_if_requested();
+    return check_open(inner_->feed(fd_fifo, data, len, micros));
+}
+
+bool ProfilingOutput::tick(int fd_fifo, uint64_t micros) {
+    dump_if_requested();
+    return check_open(inner_->tick(fd_fifo, micros));
+}
+
+bool ProfilingOutput::finish(int fd_fifo, uint64_t micros) {
+    final_dump();
+    return inner_->finish(fd_fifo, micros);
+}
+
+bool ProfilingOutput::check_open(bool fifo_open) {
+    // The capture loops do not call finish() once the FIFO is gone
+    if (!fifo_open) {
+        final_dump();
+    }
+    return fifo_open;
+}
+
+void ProfilingOutput::final_dump() {
+    if (!finished_) {
+        finished_ = true;
+        profiler_.flush();
+        dump();
+    }
+}
+
+void ProfilingOutput::dump_if_requested() {
+    if (g_latency_dump_requested) {
+        g_latency_dump_requested = 0;
+        dump();
+    }
+}
+
+void ProfilingOutput::dump() {
+    std::string text = profiler_.report();
+
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        LOG_INFO(line);
+    }
+
+    if (options_.report_path.empty()) {
+        return;
+    }
+    FILE* file = fopen(options_.report_path.c_str(), "w");
+    if (!file) {
+        LOG_ERROR("Could not write latency report: " << options_.report_path << " - " << strerror(errno));
+        return;
+    }
+    fputs(text.c_str(), file);
+    fclose(file);
+}
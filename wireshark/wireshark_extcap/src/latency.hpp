@@ -0,0 +1,128 @@
+#pragma once
+
+#include "output.hpp"
+#include "record.hpp"
+
+#include <csignal>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Log-linear (HDR style) histogram of FPGA tick counts. Values below
+// 2 * SUB_BUCKETS are counted exactly; above that every power of two is split
+// into SUB_BUCKETS buckets, so the relative error stays below 1/SUB_BUCKETS
+// (<1%) over the whole range. Fixed size (~35 KB), values past the last
+// bucket (2^MAX_BITS ticks, ~92 min) are counted in it.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 7;
+    static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAX_BITS = 40;
+    static constexpr size_t NUM_BUCKETS = 2 * SUB_BUCKETS + (MAX_BITS - SUB_BUCKET_BITS - 1) * SUB_BUCKETS;
+
+    void add(uint64_t ticks);
+
+    // Smallest value at or below which `quantile` (0..1) of the samples lie,
+    // rounded up to its bucket's upper bound
+    uint64_t percentile(double quantile) const;
+
+    uint64_t count() const { return count_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? double(sum_) / count_ : 0.0; }
+
+private:
+    static size_t bucket_index(uint64_t ticks);
+    static uint64_t bucket_upper(size_t index);
+
+    uint64_t buckets_[NUM_BUCKETS] = {};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+};
+
+// Histograms kept per key (first MOSI byte of a transaction)
+struct KeyLatency {
+    LatencyHistogram duration;   // first falling SCLK edge to the rising edge after the last one
+    LatencyHistogram interval;   // start of the previous transaction to the start of this one
+    LatencyHistogram turnaround; // end of the command byte to the end of the first response byte
+    uint64_t no_response = 0;    // transactions that ended before a response byte
+};
+
+struct LatencyOptions {
+    bool enabled = false;
+    uint8_t key_mask = 0xFF;    // applied to the first MOSI byte, e.g. 0x3F for the ADXL345 register
+    int idle_miso = -1;         // MISO byte meaning "no answer yet", skipped for turnaround; -1 = none
+    uint64_t gap_ticks = 20000; // SCLK stall that ends a transaction with CS low, 0 = CS only
+    std::string report_path;    // also written on every dump if set
+};
+
+// Measures per-command timing from the record stream. Only the first bytes
+// of a transaction are looked at, so memory does not depend on transaction
+// length; histograms are allocated the first time their key is seen, at most
+// 256 of them.
+class LatencyProfiler {
+public:
+    explicit LatencyProfiler(const LatencyOptions& options) : options_(options) {}
+
+    void add(const SpiRecord& record);
+
+    // Ends the transaction in progress, if any
+    void flush();
+
+    // Formats all histograms, one block per key
+    std::string report() const;
+
+private:
+    void finish_transaction();
+
+    LatencyOptions options_;
+    std::unique_ptr<KeyLatency> keys_[256];
+    uint64_t transactions_ = 0;
+    uint64_t short_transactions_ = 0; // ended before a whole command byte
+
+    // Transaction in progress
+    bool active_ = false;
+    bool has_previous_ = false;
+    uint64_t previous_start_ = 0;
+    uint64_t start_ = 0;
+    uint64_t end_ = 0;
+    uint64_t end_half_period_ = 0; // of the last record, 0 if its SCLK frequency is unknown
+    uint32_t bits_ = 0;
+    uint8_t mosi_byte_ = 0;
+    uint8_t miso_byte_ = 0;
+    uint8_t command_ = 0;
+    uint64_t command_end_ = 0;
+    bool responded_ = false;
+    uint64_t turnaround_ = 0;
+};
+
+// Set from SIGUSR1 to ask for a latency report while capturing
+extern volatile std::sig_atomic_t g_latency_dump_requested;
+void install_latency_dump_handler();
+
+// Capture output that profiles the records and forwards everything to the
+// output it wraps. Reports at the end of the capture and on SIGUSR1.
+class ProfilingOutput : public CaptureOutput {
+public:
+    ProfilingOutput(std::unique_ptr<CaptureOutput> inner, const LatencyOptions& options)
+        : inner_(std::move(inner)), options_(options), profiler_(options) {}
+
+    uint32_t linktype() const override { return inner_->linktype(); }
+    bool feed(int fd_fifo, const uint8_t* data, size_t len, uint64_t micros) override;
+    bool tick(int fd_fifo, uint64_t micros) override;
+    bool finish(int fd_fifo, uint64_t micros) override;
+
+private:
+    bool check_open(bool fifo_open);
+    void dump_if_requested();
+    void final_dump();
+    void dump();
+
+    std::unique_ptr<CaptureOutput> inner_;
+    LatencyOptions options_;
+    LatencyProfiler profiler_;
+    RecordFramer framer_;
+    bool finished_ = false;
+};
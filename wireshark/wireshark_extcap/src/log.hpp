@@ -0,0 +1,6 @@
+#pragma once
+
+#include <iostream>
+
+#define LOG_INFO(msg)  std::cout << "[INFO] " << msg << std::endl
+#define LOG_ERROR(msg) std::cerr << "[ERROR] " << msg << std::endl
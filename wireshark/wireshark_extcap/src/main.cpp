@@ -13,11 +13,18 @@
 #include <regex>
 #include <netinet/in.h> 
 #include <signal.h>
+#include <poll.h>
 
-namespace fs = std::filesystem;
+#include "log.hpp"
+#include "pcap.hpp"
+#include "export.hpp"
+#include "latency.hpp"
+#include "output.hpp"
+#include "realtime.hpp"
+#include "record.hpp"
+#include "replay.hpp"
 
-#define LOG_INFO(msg)  std::cout << "[INFO] " << msg << std::endl
-#define LOG_ERROR(msg) std::cerr << "[ERROR] " << msg << std::endl
+namespace fs = std::filesystem;
 
 // Function to list available UART devices
 std::vector<std::string> list_uart_devices() {
@@ -62,54 +69,29 @@ bool configure_serial_port(int fd, int baudrate) {
     return true;
 }
 
-// PCAP Global Header
-struct PcapGlobalHeader {
-    uint32_t magic_number = 0xa1b2c3d4;
-    uint16_t version_major = 2;
-    uint16_t version_minor = 4;
-    int32_t  thiszone = 0;
-    uint32_t sigfigs = 0;
-    uint32_t snaplen = 65535;
-    uint32_t network = 147; // DLT = USER0
-};
-
-void write_pcap_global_header(int fd) {
-    PcapGlobalHeader header;
-    ssize_t result = write(fd, &header, sizeof(header));
-    if (result == -1) {
-        if (errno == EPIPE || errno == EBADF) {
-            // FIFO closed by Wireshark — silently exit
-            std::exit(0);
-        } else {
-            LOG_ERROR("write() PCAP header failed: " << strerror(errno));
-            std::exit(1);
-        }
+// Function to open the FIFO Wireshark reads from and write the pcap header
+int open_capture_fifo(const std::string& fifo_path, uint32_t linktype) {
+    int fd_fifo = open(fifo_path.c_str(), O_WRONLY);
+    if (fd_fifo < 0) {
+        LOG_ERROR("Could not open FIFO: " << fifo_path << " - " << strerror(errno));
+        return -1;
     }
-}
 
-
-// PCAP Record Header, used for each packet
-struct pcaprec_hdr_t {
-    uint32_t ts_sec;         // timestamp seconds
-    uint32_t ts_usec;        // timestamp microseconds
-    uint32_t incl_len;       // number of bytes of packet saved in file
-    uint32_t orig_len;       // actual length of packet
-};
+    LOG_INFO("FIFO opened: " << fifo_path);
+    write_pcap_global_header(fd_fifo, linktype);
+    return fd_fifo;
+}
 
 // Function to run the extcap capture
-int run_extcap_capture(const std::string& fifo_path, const std::string& device_path, int baudrate, int buffer_size) {
+int run_extcap_capture(const std::string& fifo_path, const std::string& device_path, int baudrate, int buffer_size,
+                       const RealtimeOptions& realtime, CaptureOutput& output, DiskRecorder* recorder) {
     LOG_INFO("Running extcap capture...");
 
-    // Create the FIFO if it doesn't exist
-    int fd_fifo = open(fifo_path.c_str(), O_WRONLY);
+    int fd_fifo = open_capture_fifo(fifo_path, output.linktype());
     if (fd_fifo < 0) {
-        LOG_ERROR("Could not open FIFO: " << fifo_path << " - " << strerror(errno));
         return 1;
     }
 
-    LOG_INFO("FIFO opened: " << fifo_path);
-    write_pcap_global_header(fd_fifo);
-
     // Open the UART device
     int fd_uart = open(device_path.c_str(), O_RDWR | O_NOCTTY);
     if (fd_uart < 0) {
@@ -125,43 +107,41 @@ int run_extcap_capture(const std::string& fifo_path, const std::string& device_p
         return 1;
     }
 
+    if (realtime.enabled) {
+        int result = run_realtime_capture(fd_fifo, fd_uart, buffer_size, realtime, output, recorder);
+        close(fd_uart);
+        close(fd_fifo);
+        return result;
+    }
+
     uint8_t buffer[buffer_size];
 
-    // Set the UART to non-blocking mode
-    while (true) {
+    auto now_micros = []() -> uint64_t {
+        auto duration = std::chrono::system_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    };
+
+    // Wait with a timeout so time driven outputs (summaries) run on an idle bus
+    struct pollfd pfd;
+    pfd.fd = fd_uart;
+    pfd.events = POLLIN;
+
+    bool fifo_open = true;
+    while (fifo_open && !g_stop_requested) {
+        if (poll(&pfd, 1, 100) <= 0) {
+            fifo_open = output.tick(fd_fifo, now_micros());
+            continue;
+        }
+
         ssize_t bytes_read = read(fd_uart, buffer, buffer_size);
         if (bytes_read > 0) {
-            auto now = std::chrono::system_clock::now();
-            auto duration = now.time_since_epoch();
-            auto micros = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
-
-            uint32_t ts_sec = micros / 1000000;
-            uint32_t ts_usec = micros % 1000000;
-
-            pcaprec_hdr_t pkt_header;
-            pkt_header.ts_sec = ts_sec;
-            pkt_header.ts_usec = ts_usec;
-            pkt_header.incl_len = bytes_read;
-            pkt_header.orig_len = bytes_read;
-
-            ssize_t header_written = write(fd_fifo, &pkt_header, sizeof(pkt_header));
-            if (header_written == -1) {
-                if (errno == EPIPE || errno == EBADF) {
-                    break; // FIFO closed by Wireshark — exit loop
-                } else {
-                    LOG_ERROR("write() header failed: " << strerror(errno));
-                    break;
-                }
-            }
+            uint64_t micros = now_micros();
 
-            ssize_t data_written = write(fd_fifo, buffer, bytes_read);
-            if (data_written == -1) {
-                if (errno == EPIPE || errno == EBADF) {
-                    break;
-                } else {
-                    LOG_ERROR("write() data failed: " << strerror(errno));
-                    break;
-                }
+            // false once the FIFO was closed by Wireshark — exit loop
+            fifo_open = output.feed(fd_fifo, buffer, bytes_read, micros);
+
+            if (recorder) {
+                recorder->feed(buffer, bytes_read, micros);
             }
 
         } else {
@@ -169,11 +149,83 @@ int run_extcap_capture(const std::string& fifo_path, const std::string& device_p
         }
     }
 
+    if (fifo_open) {
+        output.finish(fd_fifo, now_micros());
+    }
+
     close(fd_uart);
     close(fd_fifo);
     return 0;
 }
 
+// Function to run the replay of a saved capture
+int run_extcap_replay(const std::string& fifo_path, const ReplayOptions& replay, CaptureOutput& output,
+                      DiskRecorder* recorder) {
+    LOG_INFO("Running extcap replay...");
+
+    int fd_fifo = open_capture_fifo(fifo_path, output.linktype());
+    if (fd_fifo < 0) {
+        return 1;
+    }
+
+    int result = run_replay_capture(fd_fifo, replay, output, recorder);
+    close(fd_fifo);
+    return result;
+}
+
+// Function to print the options shared by the live and the replay interface
+void print_mode_config() {
+    // Record-to-disk options
+    std::cout << "arg {number=7}{call=--record-file}{display=Record to File}"
+                 "{tooltip=Also write the decoded records to this file while capturing}"
+                 "{type=fileselect}{mustexist=false}{group=Record}\n";
+    std::cout << "arg {number=8}{call=--record-format}{display=Record Format}"
+                 "{tooltip=VCD for GTKWave, sigrok session for PulseView, or the raw UART stream}"
+                 "{type=selector}{group=Record}\n";
+    std::cout << "value {arg=8}{value=vcd}{display=VCD (.vcd)}{default=true}\n";
+    std::cout << "value {arg=8}{value=sr}{display=sigrok session (.sr)}\n";
+    std::cout << "value {arg=8}{value=raw}{display=Raw UART dump}\n";
+    std::cout << "arg {number=9}{call=--record-samplerate}{display=sigrok Sample Rate}"
+                 "{tooltip=Sample rate in Hz used for sigrok output}"
+                 "{type=string}{default=50000000}{group=Record}\n";
+    std::cout << "arg {number=17}{call=--record-max-idle}{display=sigrok Max Idle (ms)}"
+                 "{tooltip=Idle periods longer than this are shortened in sigrok output, 0 keeps the real timeline}"
+                 "{type=integer}{range=0,3600000}{default=0}{group=Record}\n";
+
+    // Capture mode
+    std::cout << "arg {number=10}{call=--capture-mode}{display=Capture Mode}"
+                 "{tooltip=Every sample record, or one aggregate summary packet per interval}"
+                 "{type=selector}{group=Mode}\n";
+    std::cout << "value {arg=10}{value=records}{display=Records}{default=true}\n";
+    std::cout << "value {arg=10}{value=chunks}{display=UART chunks (legacy)}\n";
+    std::cout << "value {arg=10}{value=summary}{display=Summary}\n";
+    std::cout << "arg {number=11}{call=--summary-interval}{display=Summary Interval (ms)}"
+                 "{tooltip=Length of one summary interval in milliseconds}"
+                 "{type=integer}{range=10,3600000}{default=1000}{group=Mode}\n";
+
+    // Message grouping (records mode)
+    std::cout << "arg {number=12}{call=--group-bits}{display=Bits per Group}"
+                 "{tooltip=Fixed number of records per message group, 0 splits at CS changes and SCLK gaps}"
+                 "{type=integer}{range=0,1000000}{default=0}{group=Mode}\n";
+    std::cout << "arg {number=13}{call=--group-gap}{display=Group Gap (us)}"
+                 "{tooltip=SCLK stall that ends a message group, 0 to only split at CS changes}"
+                 "{type=integer}{range=0,20000000}{default=100}{group=Mode}\n";
+
+    // Command-to-response latency profiling
+    std::cout << "arg {number=14}{call=--latency-profile}{display=Latency Profile}"
+                 "{tooltip=Histograms of duration, gap and turnaround per command, logged at the end and on SIGUSR1}"
+                 "{type=boolflag}{default=false}{group=Latency}\n";
+    std::cout << "arg {number=15}{call=--latency-key-mask}{display=Command Mask}"
+                 "{tooltip=Mask applied to the first MOSI byte to form the key, e.g. 0x3F to drop read/multi-byte bits}"
+                 "{type=string}{default=0xFF}{group=Latency}\n";
+    std::cout << "arg {number=16}{call=--latency-report}{display=Report File}"
+                 "{tooltip=Also write every latency report to this file}"
+                 "{type=fileselect}{mustexist=false}{group=Latency}\n";
+    std::cout << "arg {number=18}{call=--latency-idle-miso}{display=Idle MISO Byte}"
+                 "{tooltip=MISO byte a device sends while it has no answer yet, skipped when timing the turnaround; empty = none}"
+                 "{type=string}{group=Latency}\n";
+}
+
 // Main function to handle arguments and run the extcap
 int main(int argc, char* argv[]) {
     LOG_INFO("FPGA UART Extcap started");
@@ -183,17 +235,26 @@ int main(int argc, char* argv[]) {
 
     // Ignore SIGPIPE to prevent termination on broken pipe
     signal(SIGPIPE, SIG_IGN);
+    install_stop_handlers();
 
     std::string interface_name = "fpga_uart";
+    std::string replay_interface_name = "fpga_replay";
+    std::string selected_interface = interface_name;
     bool capture_mode = false;
+    bool config_requested = false;
 
-    // First pass: check if capture mode is requested
+    // First pass: check if capture mode is requested and for which interface
     for (int i = 1; i < argc; ++i) {
-        if (std::string(argv[i]) == "--capture") {
+        std::string arg(argv[i]);
+        if (arg == "--capture") {
             capture_mode = true;
-            break;
+        } else if (arg == "--extcap-config") {
+            config_requested = true;
+        } else if (arg == "--extcap-interface" && i + 1 < argc) {
+            selected_interface = argv[++i];
         }
     }
+    bool replay_mode = selected_interface == replay_interface_name;
 
     if (!capture_mode) {
         // Handle extcap discovery options
@@ -203,13 +264,27 @@ int main(int argc, char* argv[]) {
             if (arg == "--extcap-interfaces") {
                 std::cout << "extcap {version=1.0}{help=https://example.com/help}\n";
                 std::cout << "interface {value=" << interface_name << "}{display=FPGA UART Interface}\n";
+                std::cout << "interface {value=" << replay_interface_name << "}{display=FPGA Capture Replay}\n";
                 return 0;
             } else if (arg == "--extcap-interface" && i + 1 < argc) {
                 std::string iface(argv[++i]);
-                if (iface == interface_name) {
+                if ((iface == interface_name || iface == replay_interface_name) && !config_requested) {
+                    std::cout << "dlt {number=149}{name=USER2}{display=User DLT 2 (sequenced records)}\n";
                     std::cout << "dlt {number=147}{name=USER0}{display=User DLT 0}\n";
+                    std::cout << "dlt {number=148}{name=USER1}{display=User DLT 1 (bus summaries)}\n";
                     return 0;
                 }
+            } else if (arg == "--extcap-config" && replay_mode) {
+                // Replay source and pacing
+                std::cout << "arg {number=0}{call=--replay-file}{display=Capture File}"
+                             "{tooltip=Raw UART dump, pcap or pcapng file to replay}"
+                             "{type=fileselect}{mustexist=true}{required=true}{group=Replay}\n";
+                std::cout << "arg {number=1}{call=--replay-speed}{display=Speed}"
+                             "{tooltip=Multiple of the original rate (e.g. 1, 0.5, 10), 0 = as fast as possible}"
+                             "{type=string}{default=1}{group=Replay}\n";
+
+                print_mode_config();
+                return 0;
             } else if (arg == "--extcap-config") {
                 // UART device selection
                 std::cout << "arg {number=0}{call=--serial-device}{display=Serial Device}"
@@ -233,6 +308,21 @@ int main(int argc, char* argv[]) {
                              "{tooltip=Set the buffer size (e.g. 6)}"
                              "{type=string}{default=6}{group=UART}\n";
 
+                // Real-time capture options
+                std::cout << "arg {number=3}{call=--realtime}{display=Real-time Mode}"
+                             "{tooltip=Pinned SCHED_FIFO reader thread, locked memory and a prefaulted capture ring}"
+                             "{type=boolflag}{default=false}{group=Real-time}\n";
+                std::cout << "arg {number=4}{call=--rt-cpu}{display=Reader CPU}"
+                             "{tooltip=Core to pin the UART reader thread to (-1 = no pinning)}"
+                             "{type=integer}{range=-1,1023}{default=-1}{group=Real-time}\n";
+                std::cout << "arg {number=5}{call=--rt-priority}{display=SCHED_FIFO Priority}"
+                             "{tooltip=Real-time priority of the reader thread (1-99)}"
+                             "{type=integer}{range=1,99}{default=80}{group=Real-time}\n";
+                std::cout << "arg {number=6}{call=--rt-hugepages}{display=Huge Page Ring}"
+                             "{tooltip=Back the capture ring with huge pages if the system has any reserved}"
+                             "{type=boolflag}{default=false}{group=Real-time}\n";
+
+                print_mode_config();
                 return 0;
             } else if (arg == "--extcap-version") {
                 std::cout << "extcap_uart version 1.0\n";
@@ -245,6 +335,16 @@ int main(int argc, char* argv[]) {
     std::string selected_device;
     int baudrate = 12000000;  // Default baudrate
     int buffer_size = 6;      // Default buffer size
+    RealtimeOptions realtime;
+    std::string record_path;
+    std::string record_format;
+    uint64_t record_samplerate = 50000000;
+    uint64_t record_max_idle_ms = DEFAULT_SIGROK_MAX_IDLE_MS;
+    std::string capture_mode_name = "records";
+    uint32_t summary_interval_ms = 1000;
+    GroupingOptions grouping;
+    ReplayOptions replay;
+    LatencyOptions latency;
 
     // Second pass: parse the arguments
     for (int i = 1; i < argc; ++i) {
@@ -257,22 +357,128 @@ int main(int argc, char* argv[]) {
             baudrate = std::stoi(argv[++i]);
         } else if (arg == "--buffer-size" && i + 1 < argc) {
             buffer_size = std::stoi(argv[++i]);
+        } else if (arg == "--realtime") {
+            realtime.enabled = true;
+        } else if (arg == "--rt-cpu" && i + 1 < argc) {
+            realtime.cpu = std::stoi(argv[++i]);
+        } else if (arg == "--rt-priority" && i + 1 < argc) {
+            realtime.priority = std::stoi(argv[++i]);
+        } else if (arg == "--rt-hugepages") {
+            realtime.hugepages = true;
+        } else if (arg == "--record-file" && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (arg == "--record-format" && i + 1 < argc) {
+            record_format = argv[++i];
+        } else if (arg == "--record-samplerate" && i + 1 < argc) {
+            record_samplerate = std::stoull(argv[++i]);
+        } else if (arg == "--record-max-idle" && i + 1 < argc) {
+            record_max_idle_ms = std::stoull(argv[++i]);
+        } else if (arg == "--capture-mode" && i + 1 < argc) {
+            capture_mode_name = argv[++i];
+        } else if (arg == "--summary-interval" && i + 1 < argc) {
+            summary_interval_ms = std::stoul(argv[++i]);
+        } else if (arg == "--group-bits" && i + 1 < argc) {
+            grouping.group_bits = std::stoul(argv[++i]);
+        } else if (arg == "--group-gap" && i + 1 < argc) {
+            grouping.gap_ticks = std::stoull(argv[++i]) * (FPGA_CLOCK_HZ / 1000000);
+        } else if (arg == "--replay-file" && i + 1 < argc) {
+            replay.path = argv[++i];
+        } else if (arg == "--replay-speed" && i + 1 < argc) {
+            replay.speed = std::stod(argv[++i]);
+        } else if (arg == "--latency-profile") {
+            latency.enabled = true;
+        } else if (arg == "--latency-key-mask" && i + 1 < argc) {
+            unsigned long mask = std::stoul(argv[++i], nullptr, 0);
+            if (mask > 0xFF) {
+                LOG_ERROR("--latency-key-mask must be a byte (0x00-0xFF): " << argv[i]);
+                return 1;
+            }
+            latency.key_mask = uint8_t(mask);
+        } else if (arg == "--latency-idle-miso" && i + 1 < argc) {
+            std::string value = argv[++i];
+            if (!value.empty()) {
+                unsigned long idle = std::stoul(value, nullptr, 0);
+                if (idle > 0xFF) {
+                    LOG_ERROR("--latency-idle-miso must be a byte (0x00-0xFF): " << value);
+                    return 1;
+                }
+                latency.idle_miso = int(idle);
+            }
+        } else if (arg == "--latency-report" && i + 1 < argc) {
+            latency.report_path = argv[++i];
         }
     }
 
     // Check if we are in capture mode
     if (capture_mode) {
         LOG_INFO("Capture mode activated");
-        LOG_INFO("Interface: " << interface_name);
+        LOG_INFO("Interface: " << selected_interface);
         LOG_INFO("FIFO: " << fifo_path);
-        LOG_INFO("UART: " << selected_device);
-        LOG_INFO("Baudrate: " << baudrate);
-        LOG_INFO("Buffer size: " << buffer_size);
+        if (replay_mode) {
+            LOG_INFO("Replay file: " << replay.path);
+            if (replay.speed > 0) {
+                LOG_INFO("Replay speed: " << replay.speed << "x");
+            } else {
+                LOG_INFO("Replay speed: as fast as possible");
+            }
+        } else {
+            LOG_INFO("UART: " << selected_device);
+            LOG_INFO("Baudrate: " << baudrate);
+            LOG_INFO("Buffer size: " << buffer_size);
+            LOG_INFO("Real-time mode: " << (realtime.enabled ? "on" : "off"));
+        }
+        LOG_INFO("Capture mode: " << capture_mode_name);
+
+        if (!fifo_path.empty() && (replay_mode ? !replay.path.empty() : !selected_device.empty())) {
+            std::unique_ptr<CaptureOutput> output = make_capture_output(capture_mode_name, summary_interval_ms,
+                                                                         grouping);
+            if (!output) {
+                LOG_ERROR("Unknown capture mode: " << capture_mode_name);
+                return 1;
+            }
+
+            if (latency.enabled) {
+                // Transactions end where message groups do
+                latency.gap_ticks = grouping.gap_ticks;
+                LOG_INFO("Latency profile: on, send SIGUSR1 for a report while capturing");
+                install_latency_dump_handler();
+                output = std::make_unique<ProfilingOutput>(std::move(output), latency);
+            }
+
+            DiskRecorder recorder;
+            bool recording = !record_path.empty();
+            if (recording) {
+                if (record_format.empty()) {
+                    record_format = export_format_for_path(record_path);
+                }
+                LOG_INFO("Recording: " << record_path << " (" << record_format << ")");
+                if (!recorder.open(record_path, record_format, record_samplerate,
+                                   record_max_idle_ms * (FPGA_CLOCK_HZ / 1000))) {
+                    return 1;
+                }
+            }
 
-        if (!fifo_path.empty() && !selected_device.empty()) {
-            return run_extcap_capture(fifo_path, selected_device, baudrate, buffer_size);
+            int result;
+            if (replay_mode) {
+                result = run_extcap_replay(fifo_path, replay, *output, recording ? &recorder : nullptr);
+            } else {
+                result = run_extcap_capture(fifo_path, selected_device, baudrate, buffer_size, realtime, *output,
+                                            recording ? &recorder : nullptr);
+            }
+            if (recording) {
+                if (!recorder.finish()) {
+                    LOG_ERROR("Writing " << record_path << " failed");
+                    result = 1;
+                }
+                LOG_INFO("Recorded " << recorder.records() << " records to " << record_path);
+            }
+            return result;
         } else {
-            LOG_ERROR("FIFO path or UART device not specified.");
+            if (replay_mode) {
+                LOG_ERROR("FIFO path or replay file not specified.");
+            } else {
+                LOG_ERROR("FIFO path or UART device not specified.");
+            }
             return 1;
         }
     }
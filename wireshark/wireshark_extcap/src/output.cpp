@@ -0,0 +1,16 @@
+#include "output.hpp"
+#include "pcap.hpp"
+#include "sequenced.hpp"
+#include "summary.hpp"
+
+bool ChunkOutput::feed(int fd_fifo, const uint8_t* data, size_t len, uint64_t micros) {
+    return write_pcap_record(fd_fifo, micros, data, len);
+}
+
+std::unique_ptr<CaptureOutput> make_capture_output(const std::string& mode, uint32_t summary_interval_ms,
+                                                   const GroupingOptions& grouping) {
+    if (mode == "records") return std::make_unique<SequencedOutput>(grouping);
+    if (mode == "chunks") return std::make_unique<ChunkOutput>();
+    if (mode == "summary") return std::make_unique<SummaryOutput>(summary_interval_ms, grouping.gap_ticks);
+    return nullptr;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Link types of the packets the extcap writes to the FIFO
+constexpr uint32_t DLT_SPI_RECORDS = 147;   // USER0, UART reads as they arrived
+constexpr uint32_t DLT_SPI_SUMMARY = 148;   // USER1, periodic bus summaries
+constexpr uint32_t DLT_SPI_SEQUENCED = 149; // USER2, one record per packet with sequence/group header
+
+// What the capture loops hand the UART data to. An output turns the byte
+// stream into pcap packets on the FIFO; it returns false once the FIFO is gone.
+class CaptureOutput {
+public:
+    virtual ~CaptureOutput() = default;
+
+    virtual uint32_t linktype() const = 0;
+
+    // Bytes received from the device, with their host arrival time
+    virtual bool feed(int fd_fifo, const uint8_t* data, size_t len, uint64_t micros) = 0;
+
+    // Called regularly, with or without data, for time driven output
+    virtual bool tick(int fd_fifo, uint64_t micros) { return true; }
+
+    // End of capture
+    virtual bool finish(int fd_fifo, uint64_t micros) { return true; }
+};
+
+// Forwards every UART read as one packet, as it arrived
+class ChunkOutput : public CaptureOutput {
+public:
+    uint32_t linktype() const override { return DLT_SPI_RECORDS; }
+    bool feed(int fd_fifo, const uint8_t* data, size_t len, uint64_t micros) override;
+};
+
+// Builds the output for --capture-mode ("records", "chunks" or "summary");
+// nullptr if unknown. The grouping options apply to "records"; "summary" uses
+// gap_ticks to end transactions while CS stays low.
+struct GroupingOptions {
+    uint32_t group_bits = 0;   // fixed group size in records, 0 = split at CS changes and gaps
+    uint64_t gap_ticks = 20000; // SCLK stall that ends a group, FPGA ticks (100 us)
+};
+
+std::unique_ptr<CaptureOutput> make_capture_output(const std::string& mode, uint32_t summary_interval_ms,
+                                                   const GroupingOptions& grouping = GroupingOptions());
@@ -0,0 +1,48 @@
+#include "pcap.hpp"
+#include "log.hpp"
+
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+
+void write_pcap_global_header(int fd, uint32_t linktype) {
+    PcapGlobalHeader header;
+    header.network = linktype;
+    ssize_t result = write(fd, &header, sizeof(header));
+    if (result == -1) {
+        if (errno == EPIPE || errno == EBADF) {
+            // FIFO closed by Wireshark — silently exit
+            std::exit(0);
+        } else {
+            LOG_ERROR("write() PCAP header failed: " << strerror(errno));
+            std::exit(1);
+        }
+    }
+}
+
+bool write_pcap_record(int fd, uint64_t micros, const uint8_t* data, size_t len) {
+    pcaprec_hdr_t pkt_header;
+    pkt_header.ts_sec = micros / 1000000;
+    pkt_header.ts_usec = micros % 1000000;
+    pkt_header.incl_len = len;
+    pkt_header.orig_len = len;
+
+    ssize_t header_written = write(fd, &pkt_header, sizeof(pkt_header));
+    if (header_written == -1) {
+        if (errno != EPIPE && errno != EBADF) {
+            LOG_ERROR("write() header failed: " << strerror(errno));
+        }
+        return false; // FIFO closed by Wireshark — exit loop
+    }
+
+    ssize_t data_written = write(fd, data, len);
+    if (data_written == -1) {
+        if (errno != EPIPE && errno != EBADF) {
+            LOG_ERROR("write() data failed: " << strerror(errno));
+        }
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// PCAP Global Header
+struct PcapGlobalHeader {
+    uint32_t magic_number = 0xa1b2c3d4;
+    uint16_t version_major = 2;
+    uint16_t version_minor = 4;
+    int32_t  thiszone = 0;
+    uint32_t sigfigs = 0;
+    uint32_t snaplen = 65535;
+    uint32_t network = 147; // DLT = USER0
+};
+
+// PCAP Record Header, used for each packet
+struct pcaprec_hdr_t {
+    uint32_t ts_sec;         // timestamp seconds
+    uint32_t ts_usec;        // timestamp microseconds
+    uint32_t incl_len;       // number of bytes of packet saved in file
+    uint32_t orig_len;       // actual length of packet
+};
+
+// Writes the global header, exits quietly if Wireshark already closed the FIFO
+void write_pcap_global_header(int fd, uint32_t linktype = 147);
+
+// Writes one packet (record header + data). Returns false once the FIFO is gone
+// or a write fails, so the caller can leave its capture loop.
+bool write_pcap_record(int fd, uint64_t micros, const uint8_t* data, size_t len);
@@ -0,0 +1,357 @@
+#include "realtime.hpp"
+#include "log.hpp"
+#include "pcap.hpp"
+#include "export.hpp"
+#include "output.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <thread>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+volatile std::sig_atomic_t g_stop_requested = 0;
+
+static void handle_stop_signal(int) {
+    g_stop_requested = 1;
+}
+
+void install_stop_handlers() {
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    // No SA_RESTART: a blocking read() must return so the loop sees the flag
+    sigaction(SIGTERM, &sa, nullptr);
+    sigaction(SIGINT, &sa, nullptr);
+}
+
+static uint64_t monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t wallclock_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// ---------------------------------------------------------------------------
+// Scheduling latency statistics
+// ---------------------------------------------------------------------------
+
+constexpr uint64_t SchedLatencyStats::BUCKET_LIMITS_NS[];
+
+void SchedLatencyStats::add(uint64_t latency_ns) {
+    samples++;
+    sum_ns += latency_ns;
+    if (latency_ns < min_ns) min_ns = latency_ns;
+    if (latency_ns > max_ns) max_ns = latency_ns;
+
+    int bucket = 0;
+    while (bucket < NUM_BUCKETS - 1 && latency_ns >= BUCKET_LIMITS_NS[bucket]) {
+        bucket++;
+    }
+    buckets[bucket]++;
+}
+
+void SchedLatencyStats::report() const {
+    if (samples == 0) {
+        LOG_INFO("Scheduling latency: no timer wakeups observed");
+        return;
+    }
+
+    LOG_INFO("Scheduling latency over " << samples << " wakeups: min " << min_ns / 1000.0
+             << " us, avg " << (sum_ns / samples) / 1000.0 << " us, max " << max_ns / 1000.0 << " us");
+
+    static const char* labels[NUM_BUCKETS] = {
+        "    < 10 us", "    < 50 us", "   < 100 us", "   < 500 us", "     < 1 ms", "     < 5 ms", "    >= 5 ms"
+    };
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        LOG_INFO("  " << labels[i] << ": " << buckets[i]);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Capture ring
+// ---------------------------------------------------------------------------
+
+static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+CaptureRing::~CaptureRing() {
+    if (memory_) {
+        munmap(memory_, mapped_size_);
+    }
+}
+
+bool CaptureRing::allocate(size_t slots, size_t chunk_size, bool hugepages) {
+    slots_ = slots;
+    chunk_size_ = chunk_size;
+    // Keep each slot on its own cache line(s) so the two threads never share one
+    stride_ = (sizeof(Slot) + chunk_size + 63) & ~size_t(63);
+
+    size_t bytes = slots_ * stride_;
+    void* mem = MAP_FAILED;
+
+    if (hugepages) {
+        mapped_size_ = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        mem = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (mem == MAP_FAILED) {
+            LOG_INFO("Huge pages unavailable (" << strerror(errno) << "), using normal pages");
+        }
+    }
+
+    if (mem == MAP_FAILED) {
+        mapped_size_ = bytes;
+        mem = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (mem == MAP_FAILED) {
+            LOG_ERROR("Failed to map capture ring: " << strerror(errno));
+            return false;
+        }
+    } else {
+        hugepages_ = true;
+    }
+
+    memory_ = static_cast<uint8_t*>(mem);
+
+    // Touch every page so no fault happens inside the capture loop
+    std::memset(memory_, 0, mapped_size_);
+    return true;
+}
+
+CaptureRing::Slot* CaptureRing::producer_slot() {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= slots_) {
+        return nullptr; // full
+    }
+    return slot_at(head);
+}
+
+void CaptureRing::produce() {
+    head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+CaptureRing::Slot* CaptureRing::consumer_slot() {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) {
+        return nullptr; // empty
+    }
+    return slot_at(tail);
+}
+
+void CaptureRing::consume() {
+    tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// ---------------------------------------------------------------------------
+// Real-time capture
+// ---------------------------------------------------------------------------
+
+struct ReaderState {
+    int fd_uart;
+    CaptureRing* ring;
+    std::atomic<bool> stop{false};
+    std::atomic<bool> failed{false};
+    uint64_t chunks_read = 0;
+    uint64_t chunks_dropped = 0;
+    SchedLatencyStats latency;
+};
+
+// Function to move the calling thread to SCHED_FIFO and pin it to a core
+static void apply_thread_policy(const RealtimeOptions& options) {
+    if (options.cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(options.cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0) {
+            LOG_ERROR("Could not pin reader thread to CPU " << options.cpu << ": " << strerror(err));
+        } else {
+            LOG_INFO("Reader thread pinned to CPU " << options.cpu);
+        }
+    }
+
+    struct sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    int max_priority = sched_get_priority_max(SCHED_FIFO);
+    int min_priority = sched_get_priority_min(SCHED_FIFO);
+    param.sched_priority = std::max(min_priority, std::min(options.priority, max_priority));
+
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0) {
+        // Typically EPERM without CAP_SYS_NICE or an RLIMIT_RTPRIO grant.
+        // Keep running as a normal thread, but make it as favoured as we may.
+        LOG_INFO("SCHED_FIFO not permitted (" << strerror(err) << "), staying on SCHED_OTHER");
+        errno = 0;
+        if (nice(-20) == -1 && errno != 0) {
+            LOG_INFO("Could not raise reader thread priority: " << strerror(errno));
+        }
+    } else {
+        LOG_INFO("Reader thread running SCHED_FIFO priority " << param.sched_priority);
+    }
+}
+
+// Function run by the UART reader thread
+static void reader_loop(ReaderState* state, RealtimeOptions options) {
+    apply_thread_policy(options);
+
+    // Period of the timer used to sample scheduling latency. It also bounds
+    // how long the loop waits before it checks for a stop request.
+    constexpr uint64_t WAKEUP_PERIOD_NS = 1000000;
+
+    int fd_timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd_timer < 0) {
+        LOG_ERROR("timerfd_create() failed: " << strerror(errno));
+        state->failed = true;
+        return;
+    }
+    uint64_t next_expiry = monotonic_ns() + WAKEUP_PERIOD_NS;
+    struct itimerspec spec;
+    std::memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = next_expiry / 1000000000;
+    spec.it_value.tv_nsec = next_expiry % 1000000000;
+    spec.it_interval.tv_nsec = WAKEUP_PERIOD_NS;
+    timerfd_settime(fd_timer, TFD_TIMER_ABSTIME, &spec, nullptr);
+
+    struct pollfd pfds[2];
+    pfds[0].fd = state->fd_uart;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = fd_timer;
+    pfds[1].events = POLLIN;
+
+    while (!state->stop.load(std::memory_order_relaxed) && !g_stop_requested) {
+        int ready = poll(pfds, 2, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("poll() on UART failed: " << strerror(errno));
+            state->failed = true;
+            break;
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            uint64_t woke = monotonic_ns();
+            uint64_t expirations = 0;
+            if (read(fd_timer, &expirations, sizeof(expirations)) == sizeof(expirations) && expirations > 0) {
+                // Only the latest expiry counts, earlier ones were missed entirely
+                uint64_t expiry = next_expiry + (expirations - 1) * WAKEUP_PERIOD_NS;
+                state->latency.add(woke > expiry ? woke - expiry : 0);
+                next_expiry += expirations * WAKEUP_PERIOD_NS;
+            }
+        }
+        // A hung up tty (adapter unplugged) stays readable and reads 0 bytes
+        // forever, which would spin this thread at SCHED_FIFO. Data still
+        // queued is read first; the read that comes back empty ends the loop.
+        if (pfds[0].revents & (POLLERR | POLLNVAL)) {
+            LOG_ERROR("UART device error, stopping capture");
+            state->failed = true;
+            break;
+        }
+        if ((pfds[0].revents & POLLHUP) && !(pfds[0].revents & POLLIN)) {
+            LOG_ERROR("UART device hung up, stopping capture");
+            state->failed = true;
+            break;
+        }
+        if (!(pfds[0].revents & POLLIN)) {
+            continue;
+        }
+
+        CaptureRing::Slot* slot = state->ring->producer_slot();
+        uint8_t scratch[4096];
+        // Writer fell behind; drain the UART anyway so the FTDI never backs up
+        uint8_t* target = slot ? slot->data() : scratch;
+        size_t target_size = slot ? state->ring->chunk_size() : std::min(sizeof(scratch), state->ring->chunk_size());
+
+        ssize_t bytes_read = read(state->fd_uart, target, target_size);
+        if (bytes_read > 0) {
+            if (!slot) {
+                state->chunks_dropped++;
+                continue;
+            }
+            slot->micros = wallclock_us();
+            slot->len = bytes_read;
+            state->ring->produce();
+            state->chunks_read++;
+        } else if (bytes_read == 0) {
+            LOG_ERROR("UART device closed (read returned 0), stopping capture");
+            state->failed = true;
+            break;
+        } else if (errno != EINTR && errno != EAGAIN) {
+            LOG_ERROR("read() on UART failed: " << strerror(errno));
+            state->failed = true;
+            break;
+        }
+    }
+
+    close(fd_timer);
+}
+
+int run_realtime_capture(int fd_fifo, int fd_uart, int buffer_size, const RealtimeOptions& options,
+                         CaptureOutput& output, DiskRecorder* recorder) {
+    LOG_INFO("Real-time capture mode enabled");
+
+    CaptureRing ring;
+    if (!ring.allocate(options.ring_slots, buffer_size, options.hugepages)) {
+        return 1;
+    }
+    LOG_INFO("Capture ring: " << options.ring_slots << " slots of " << buffer_size << " bytes"
+             << (ring.uses_hugepages() ? " on huge pages" : ""));
+
+    ReaderState state;
+    state.fd_uart = fd_uart;
+    state.ring = &ring;
+
+    std::thread reader;
+    try {
+        reader = std::thread(reader_loop, &state, options);
+    } catch (const std::system_error& e) {
+        LOG_ERROR("Could not start the reader thread: " << e.what());
+        return 1;
+    }
+
+    // Lock what is mapped now, once the ring and the reader's stack exist, so
+    // neither can be paged out mid-capture. Locking first would count the
+    // ring against RLIMIT_MEMLOCK and make its mapping fail.
+    if (mlockall(MCL_CURRENT) != 0) {
+        LOG_INFO("mlockall() failed (" << strerror(errno) << "), continuing without locked memory");
+        munlockall();
+    }
+
+    bool fifo_open = true;
+    while (fifo_open && !g_stop_requested) {
+        CaptureRing::Slot* slot = ring.consumer_slot();
+        if (!slot) {
+            // The reader stopped on a dead device; what it read is written first
+            if (state.failed) break;
+            fifo_open = output.tick(fd_fifo, wallclock_us());
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+
+        fifo_open = output.feed(fd_fifo, slot->data(), slot->len, slot->micros);
+        if (recorder) {
+            recorder->feed(slot->data(), slot->len, slot->micros);
+        }
+        ring.consume();
+    }
+
+    state.stop = true;
+    reader.join();
+
+    if (fifo_open) {
+        output.finish(fd_fifo, wallclock_us());
+    }
+
+    LOG_INFO("Chunks read: " << state.chunks_read << ", dropped (ring full): " << state.chunks_dropped);
+    state.latency.report();
+
+    return state.failed ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <csignal>
+
+// Options for the opt-in low-jitter capture mode (--realtime)
+struct RealtimeOptions {
+    bool enabled = false;
+    int cpu = -1;              // core the UART reader thread is pinned to, -1 = no pinning
+    int priority = 80;         // SCHED_FIFO priority of the reader thread
+    bool hugepages = false;    // back the capture ring with huge pages if available
+    size_t ring_slots = 65536; // number of read chunks the ring can hold
+};
+
+// Scheduling latency seen by the reader thread. A periodic timer runs next to
+// the UART, so wakeups are sampled on a busy bus too; the overshoot past each
+// expiry is how late the scheduler ran us.
+struct SchedLatencyStats {
+    static constexpr int NUM_BUCKETS = 7;
+    static constexpr uint64_t BUCKET_LIMITS_NS[NUM_BUCKETS - 1] = {
+        10000, 50000, 100000, 500000, 1000000, 5000000
+    };
+
+    uint64_t samples = 0;
+    uint64_t sum_ns = 0;
+    uint64_t min_ns = UINT64_MAX;
+    uint64_t max_ns = 0;
+    uint64_t buckets[NUM_BUCKETS] = {};
+
+    void add(uint64_t latency_ns);
+    void report() const;
+};
+
+// Single producer / single consumer ring of fixed-size slots. Each slot holds
+// one read() chunk and the time it was read, so host timestamps reflect when
+// the data arrived rather than when it was forwarded to Wireshark.
+class CaptureRing {
+public:
+    struct Slot {
+        uint64_t micros;
+        uint32_t len;
+        uint8_t* data() { return reinterpret_cast<uint8_t*>(this + 1); }
+    };
+
+    CaptureRing() = default;
+    ~CaptureRing();
+    CaptureRing(const CaptureRing&) = delete;
+    CaptureRing& operator=(const CaptureRing&) = delete;
+
+    // Maps and prefaults the ring. Falls back to normal pages if huge pages
+    // were requested but none are available.
+    bool allocate(size_t slots, size_t chunk_size, bool hugepages);
+
+    size_t chunk_size() const { return chunk_size_; }
+    bool uses_hugepages() const { return hugepages_; }
+
+    // Producer side
+    Slot* producer_slot();
+    void produce();
+
+    // Consumer side
+    Slot* consumer_slot();
+    void consume();
+
+private:
+    Slot* slot_at(uint64_t index) { return reinterpret_cast<Slot*>(memory_ + (index % slots_) * stride_); }
+
+    uint8_t* memory_ = nullptr;
+    size_t mapped_size_ = 0;
+    size_t slots_ = 0;
+    size_t stride_ = 0;
+    size_t chunk_size_ = 0;
+    bool hugepages_ = false;
+
+    alignas(64) std::atomic<uint64_t> head_{0}; // written by the producer
+    alignas(64) std::atomic<uint64_t> tail_{0}; // written by the consumer
+};
+
+// Set from SIGTERM/SIGINT so the capture loops can shut down and report
+extern volatile std::sig_atomic_t g_stop_requested;
+void install_stop_handlers();
+
+class CaptureOutput;
+class DiskRecorder;
+
+// Runs the capture with a pinned, SCHED_FIFO UART reader thread feeding the
+// FIFO writer through a locked, prefaulted ring. `recorder` may be null.
+int run_realtime_capture(int fd_fifo, int fd_uart, int buffer_size, const RealtimeOptions& options,
+                         CaptureOutput& output, DiskRecorder* recorder);
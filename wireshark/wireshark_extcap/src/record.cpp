@@ -0,0 +1,60 @@
+#include "record.hpp"
+
+SpiRecord decode_record(const uint8_t* bytes) {
+    SpiRecord record;
+    record.miso = (bytes[0] & 0x80) != 0;
+    record.mosi = (bytes[0] & 0x40) != 0;
+    record.cs   = (bytes[0] & 0x20) != 0;
+    record.sclk_freq = ((bytes[0] & 0x1F) << 8) | bytes[1];
+    record.timestamp = (uint32_t(bytes[2]) << 24) | (uint32_t(bytes[3]) << 16) |
+                       (uint32_t(bytes[4]) << 8) | uint32_t(bytes[5]);
+    return record;
+}
+
+void encode_record(const SpiRecord& record, uint8_t* bytes) {
+    uint32_t timestamp = static_cast<uint32_t>(record.timestamp);
+    bytes[0] = (record.miso ? 0x80 : 0) | (record.mosi ? 0x40 : 0) | (record.cs ? 0x20 : 0) |
+               ((record.sclk_freq >> 8) & 0x1F);
+    bytes[1] = record.sclk_freq & 0xFF;
+    bytes[2] = timestamp >> 24;
+    bytes[3] = timestamp >> 16;
+    bytes[4] = timestamp >> 8;
+    bytes[5] = timestamp;
+}
+
+uint64_t TimestampUnwrapper::unwrap(uint32_t raw, uint64_t host_micros) {
+    constexpr uint64_t WRAP = uint64_t(1) << 32;
+
+    if (!started_) {
+        started_ = true;
+        last_raw_ = raw;
+        last_host_micros_ = host_micros;
+        current_ = raw;
+        return current_;
+    }
+
+    // Modular difference covers a single wrap on its own
+    uint64_t ticks = uint32_t(raw - last_raw_);
+
+    // Longer idle periods can hide whole wraps; the host clock tells how many
+    if (host_micros != 0 && last_host_micros_ != 0 && host_micros > last_host_micros_) {
+        uint64_t host_ticks = (host_micros - last_host_micros_) * (FPGA_CLOCK_HZ / 1000000);
+        if (host_ticks > ticks + WRAP / 2) {
+            ticks += ((host_ticks - ticks + WRAP / 2) / WRAP) * WRAP;
+        }
+    }
+
+    current_ += ticks;
+    last_raw_ = raw;
+    if (host_micros != 0) {
+        last_host_micros_ = host_micros;
+    }
+    return current_;
+}
+
+SpiRecord RecordFramer::finish(const uint8_t* bytes, uint64_t host_micros) {
+    SpiRecord record = decode_record(bytes);
+    record.timestamp = unwrapper_.unwrap(static_cast<uint32_t>(record.timestamp), host_micros);
+    records_++;
+    return record;
+}
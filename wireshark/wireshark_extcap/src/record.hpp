@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// One sample word as sent by the FPGA, 48 bits MSB first (see spi.vhd):
+//   [47]    MISO
+//   [46]    MOSI
+//   [45]    CS
+//   [44:32] SCLK frequency in units of 2^17 Hz
+//   [31:0]  timestamp_counter, 200 MHz (5 ns per tick)
+constexpr size_t RECORD_SIZE = 6;
+constexpr uint64_t FPGA_CLOCK_HZ = 200000000;
+constexpr uint64_t NS_PER_TICK = 1000000000 / FPGA_CLOCK_HZ;
+constexpr uint32_t SCLK_FREQ_UNIT_HZ = 131072;
+
+struct SpiRecord {
+    uint64_t timestamp; // unwrapped FPGA counter ticks
+    uint16_t sclk_freq; // raw 13-bit value, multiply by SCLK_FREQ_UNIT_HZ for Hz
+    bool miso;
+    bool mosi;
+    bool cs;
+};
+
+// Decodes the fields of a 6 byte record. The timestamp is the raw 32-bit counter.
+SpiRecord decode_record(const uint8_t* bytes);
+
+// Encodes a record back into its 6 byte wire form (timestamp truncated to 32 bits)
+void encode_record(const SpiRecord& record, uint8_t* bytes);
+
+// Half an SCLK period in FPGA ticks for a raw frequency value, 0 if unknown
+inline uint64_t sclk_half_period_ticks(uint16_t sclk_freq) {
+    return sclk_freq != 0 ? FPGA_CLOCK_HZ / (2 * uint64_t(sclk_freq) * SCLK_FREQ_UNIT_HZ) : 0;
+}
+
+// Turns the wrapping 32-bit FPGA counter into a monotonic 64-bit one. The
+// counter wraps every ~21.5 s, so when host timestamps are available they are
+// used to recover wraps the bus was idle for.
+class TimestampUnwrapper {
+public:
+    uint64_t unwrap(uint32_t raw, uint64_t host_micros = 0);
+
+private:
+    bool started_ = false;
+    uint32_t last_raw_ = 0;
+    uint64_t last_host_micros_ = 0;
+    uint64_t current_ = 0;
+};
+
+// Reassembles records from a byte stream that may be split at any point
+// (UART reads, pcap packets) and hands back decoded, unwrapped records.
+class RecordFramer {
+public:
+    // Feeds bytes in; calls emit(const SpiRecord&) for every complete record
+    template <typename Emit>
+    void feed(const uint8_t* data, size_t len, uint64_t host_micros, Emit&& emit) {
+        while (len > 0) {
+            if (pending_ == 0 && len >= RECORD_SIZE) {
+                emit(finish(data, host_micros));
+                data += RECORD_SIZE;
+                len -= RECORD_SIZE;
+                continue;
+            }
+            partial_[pending_++] = *data++;
+            len--;
+            if (pending_ == RECORD_SIZE) {
+                pending_ = 0;
+                emit(finish(partial_, host_micros));
+            }
+        }
+    }
+
+    uint64_t records() const { return records_; }
+    // Bytes of a record held back until the rest of it arrives
+    size_t pending() const { return pending_; }
+
+private:
+    SpiRecord finish(const uint8_t* bytes, uint64_t host_micros);
+
+    uint8_t partial_[RECORD_SIZE] = {};
+    size_t pending_ = 0;
+    uint64_t records_ = 0;
+    TimestampUnwrapper unwrapper_;
+};
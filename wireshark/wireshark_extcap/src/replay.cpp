@@ -0,0 +1,236 @@
+#include "replay.hpp"
+#include "capture_file.hpp"
+#include "export.hpp"
+#include "log.hpp"
+#include "output.hpp"
+#include "realtime.hpp"
+#include "record.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+static constexpr size_t BATCH_RECORDS = 512;               // records per feed(), like one large UART read
+static constexpr uint64_t PACING_SLACK_NS = 50000;         // records due this soon go out with the current batch
+static constexpr uint64_t SPIN_NS = 50000;                 // the timer wakes this early, the rest is busy waited
+static constexpr uint64_t TICK_PERIOD_NS = 100000000;      // longest sleep without an output tick
+static constexpr uint64_t PROGRESS_PERIOD_NS = 10000000000; // interval of the progress lines
+// A batch is stamped with one host time, so TimestampUnwrapper downstream can
+// only see wraps between batches. Keeping a batch well within half a wrap of
+// the 32-bit counter (~21.5 s) lets it recover every wrap from the host times.
+static constexpr uint64_t BATCH_MAX_SPAN_TICKS = (uint64_t(1) << 32) / 4;
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t wallclock_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Absolute CLOCK_MONOTONIC timer. Sleeping on it is cheap but only accurate to
+// the timer slack and wakeup latency, so callers wake SPIN_NS early and busy
+// wait the rest.
+class PacingTimer {
+public:
+    ~PacingTimer() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    bool open() {
+        fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (fd_ < 0) {
+            LOG_ERROR("timerfd_create() failed: " << strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    // Returns false if the wait failed for another reason than a signal
+    bool sleep_until(uint64_t deadline_ns) {
+        struct itimerspec spec;
+        std::memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_sec = deadline_ns / 1000000000;
+        spec.it_value.tv_nsec = deadline_ns % 1000000000;
+        if (timerfd_settime(fd_, TFD_TIMER_ABSTIME, &spec, nullptr) < 0) {
+            LOG_ERROR("timerfd_settime() failed: " << strerror(errno));
+            return false;
+        }
+
+        uint64_t expirations;
+        if (read(fd_, &expirations, sizeof(expirations)) < 0 && errno != EINTR) {
+            LOG_ERROR("read() on timerfd failed: " << strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+// Function to log how far the replay got and how fast it runs
+static void report_rate(const char* prefix, uint64_t records, uint64_t span_ticks, uint64_t elapsed_ns,
+                        double speed) {
+    double span_s = double(span_ticks) * NS_PER_TICK / 1e9;
+    double elapsed_s = double(elapsed_ns) / 1e9;
+    char line[200];
+    if (speed > 0) {
+        snprintf(line, sizeof(line), "%s %llu records, %.3f s of capture in %.3f s: %.3fx (requested %gx)",
+                 prefix, (unsigned long long)records, span_s, elapsed_s,
+                 elapsed_s > 0 ? span_s / elapsed_s : 0.0, speed);
+    } else {
+        snprintf(line, sizeof(line), "%s %llu records, %.3f s of capture in %.3f s: %.3fx (as fast as possible)",
+                 prefix, (unsigned long long)records, span_s, elapsed_s, elapsed_s > 0 ? span_s / elapsed_s : 0.0);
+    }
+    LOG_INFO(line);
+    if (elapsed_s > 0) {
+        snprintf(line, sizeof(line), "  %.0f records/s achieved, %.0f records/s in the original capture",
+                 records / elapsed_s, span_s > 0 ? records / span_s : 0.0);
+        LOG_INFO(line);
+    }
+}
+
+int run_replay_capture(int fd_fifo, const ReplayOptions& options, CaptureOutput& output, DiskRecorder* recorder) {
+    LOG_INFO("Replaying " << options.path);
+
+    CaptureReader reader;
+    if (!reader.open(options.path)) {
+        return 1;
+    }
+
+    PacingTimer timer;
+    if (!timer.open()) {
+        return 1;
+    }
+
+    const bool paced = options.speed > 0;
+    uint8_t batch[BATCH_RECORDS * RECORD_SIZE];
+    size_t batch_len = 0;
+
+    bool started = false;
+    uint64_t first_ts = 0;
+    uint64_t batch_first_ts = 0;
+    uint64_t last_ts = 0;
+    uint64_t start_ns = 0;
+    uint64_t start_us = 0;
+    uint64_t next_progress_ns = 0;
+    uint64_t records = 0;
+    SchedLatencyStats lateness;
+    bool fifo_open = true;
+
+    // Packet times follow the capture timeline, so Wireshark shows the
+    // original spacing and the outputs can rely on them at any speed
+    auto timeline_us = [&](uint64_t ts) {
+        return start_us + (ts - first_ts) * NS_PER_TICK / 1000;
+    };
+    auto due_ns = [&](uint64_t ts) {
+        return start_ns + uint64_t(double((ts - first_ts) * NS_PER_TICK) / options.speed);
+    };
+
+    auto flush = [&]() {
+        if (batch_len == 0) return;
+        uint64_t micros = timeline_us(last_ts);
+        fifo_open = output.feed(fd_fifo, batch, batch_len, micros);
+        if (recorder) {
+            recorder->feed(batch, batch_len, micros);
+        }
+        batch_len = 0;
+
+        uint64_t now = monotonic_ns();
+        if (now >= next_progress_ns) {
+            report_rate("Replayed", records, last_ts - first_ts, now - start_ns, options.speed);
+            next_progress_ns = now + PROGRESS_PERIOD_NS;
+        }
+    };
+
+    // Sleeps until `due`, ticking the output during long idle periods.
+    // False if the replay should stop.
+    auto wait_until = [&](uint64_t due) {
+        while (!g_stop_requested) {
+            uint64_t now = monotonic_ns();
+            if (now + SPIN_NS >= due) break;
+
+            uint64_t wake = std::min(due - SPIN_NS, now + TICK_PERIOD_NS);
+            if (!timer.sleep_until(wake)) return false;
+            if (wake < due - SPIN_NS) {
+                uint64_t replayed_ns = uint64_t(double(monotonic_ns() - start_ns) * options.speed);
+                fifo_open = output.tick(fd_fifo, start_us + replayed_ns / 1000);
+                if (!fifo_open) return false;
+            }
+        }
+        while (!g_stop_requested && monotonic_ns() < due) {
+        }
+        return !g_stop_requested;
+    };
+
+    SpiRecord record;
+    while (fifo_open && !g_stop_requested && reader.next(record)) {
+        if (!started) {
+            started = true;
+            first_ts = record.timestamp;
+            start_ns = monotonic_ns();
+            start_us = wallclock_us();
+            next_progress_ns = start_ns + PROGRESS_PERIOD_NS;
+        }
+
+        if (paced) {
+            uint64_t due = due_ns(record.timestamp);
+            if (due > monotonic_ns() + PACING_SLACK_NS) {
+                flush();
+                if (!fifo_open || !wait_until(due)) break;
+                uint64_t now = monotonic_ns();
+                lateness.add(now > due ? now - due : 0);
+            }
+        }
+
+        if (batch_len != 0 && record.timestamp - batch_first_ts > BATCH_MAX_SPAN_TICKS) {
+            flush();
+            if (!fifo_open) break;
+        }
+        if (batch_len == 0) {
+            batch_first_ts = record.timestamp;
+        }
+
+        encode_record(record, batch + batch_len);
+        batch_len += RECORD_SIZE;
+        last_ts = record.timestamp;
+        records++;
+
+        if (batch_len == sizeof(batch)) {
+            flush();
+        }
+    }
+
+    if (fifo_open) {
+        flush();
+    }
+    if (fifo_open) {
+        output.finish(fd_fifo, timeline_us(last_ts));
+    }
+
+    if (reader.failed()) {
+        LOG_ERROR("Could not read all of " << options.path);
+        return 1;
+    }
+    if (!started) {
+        LOG_INFO("No records in " << options.path);
+        return 0;
+    }
+
+    report_rate("Replay finished:", records, last_ts - first_ts, monotonic_ns() - start_ns, options.speed);
+    if (paced) {
+        lateness.report();
+    }
+    return 0;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+// Options of the replay interface (fpga_replay)
+struct ReplayOptions {
+    std::string path;   // raw dump, pcap or pcapng (see CaptureReader)
+    double speed = 1.0; // multiple of the original rate, 0 = as fast as possible
+};
+
+class CaptureOutput;
+class DiskRecorder;
+
+// Replays the records of a saved capture into the FIFO through `output`, paced
+// by their FPGA timestamps. Packet times follow the original timeline from
+// the start of the replay, whatever the speed. `recorder` may be null.
+int run_replay_capture(int fd_fifo, const ReplayOptions& options, CaptureOutput& output, DiskRecorder* recorder);
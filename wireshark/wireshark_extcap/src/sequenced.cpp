@@ -0,0 +1,76 @@
+#include "sequenced.hpp"
+#include "pcap.hpp"
+
+static void put_be32(uint8_t* out, uint32_t value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+bool SequencedOutput::feed(int fd_fifo, const uint8_t* data, size_t len, uint64_t micros) {
+    bool ok = true;
+    framer_.feed(data, len, micros, [&](const SpiRecord& record) {
+        if (ok) ok = add_record(fd_fifo, record, micros);
+    });
+    return ok;
+}
+
+bool SequencedOutput::add_record(int fd_fifo, const SpiRecord& record, uint64_t micros) {
+    // Does this record start a new group? Fixed size groups only end on
+    // their size, so the held record may already have been written by tick()
+    bool boundary;
+    if (options_.group_bits != 0) {
+        boundary = !started_ || position_ + 1 >= options_.group_bits;
+    } else {
+        boundary = !held_ ||
+                   record.cs != held_record_.cs ||
+                   (options_.gap_ticks != 0 && record.timestamp - held_record_.timestamp > options_.gap_ticks);
+    }
+
+    if (held_ && !write_held(fd_fifo, boundary)) {
+        return false;
+    }
+
+    if (boundary) {
+        if (started_) group_++;
+        started_ = true;
+        position_ = 0;
+    } else {
+        position_++;
+    }
+
+    held_ = true;
+    held_first_ = boundary;
+    held_record_ = record;
+    held_micros_ = micros;
+    return true;
+}
+
+bool SequencedOutput::write_held(int fd_fifo, bool last) {
+    uint8_t packet[SEQUENCED_HEADER_SIZE + RECORD_SIZE] = {};
+    packet[0] = SEQUENCED_VERSION;
+    packet[1] = (held_first_ ? SEQ_FLAG_FIRST : 0) | (last ? SEQ_FLAG_LAST : 0);
+    put_be32(packet + 4, sequence_++);
+    put_be32(packet + 8, group_);
+    put_be32(packet + 12, position_);
+    encode_record(held_record_, packet + SEQUENCED_HEADER_SIZE);
+
+    held_ = false;
+    return write_pcap_record(fd_fifo, held_micros_, packet, sizeof(packet));
+}
+
+bool SequencedOutput::tick(int fd_fifo, uint64_t micros) {
+    // Nothing followed for a while: write the held record instead of holding
+    // it back until the bus wakes up again. That closes a split group; a fixed
+    // size group stays open unless the record was its last.
+    if (held_ && micros - held_micros_ > GROUP_IDLE_FLUSH_US) {
+        bool last = options_.group_bits == 0 || position_ + 1 >= options_.group_bits;
+        return write_held(fd_fifo, last);
+    }
+    return true;
+}
+
+bool SequencedOutput::finish(int fd_fifo, uint64_t micros) {
+    return held_ ? write_held(fd_fifo, true) : true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "output.hpp"
+#include "record.hpp"
+
+#include <cstdint>
+
+// Header in front of every record on DLT 149, big endian like the records:
+//   0   1  version (1)
+//   1   1  flags, see SEQ_FLAG_*
+//   2   2  reserved, 0
+//   4   4  sequence number of the record, counts every record written
+//   8   4  group (message) number
+//   12  4  position of the record in its group, from 0
+//   16  6  the FPGA record
+constexpr uint8_t SEQUENCED_VERSION = 1;
+constexpr size_t SEQUENCED_HEADER_SIZE = 16;
+constexpr uint8_t SEQ_FLAG_FIRST = 0x01; // first record of a group
+constexpr uint8_t SEQ_FLAG_LAST = 0x02;  // last record of a group
+
+// How long a group may wait for its next record before it is closed
+constexpr uint64_t GROUP_IDLE_FLUSH_US = 100000;
+
+// Capture output for --capture-mode records: one packet per record with
+// sequence and group metadata, so the dissector does not have to derive
+// groups from frame numbers. A group ends at a CS change or when SCLK stalls
+// for longer than gap_ticks; if group_bits is set, groups are exactly that
+// many records instead. A record is held back until the next one shows whether
+// it ends its group.
+class SequencedOutput : public CaptureOutput {
+public:
+    explicit SequencedOutput(const GroupingOptions& options) : options_(options) {}
+
+    uint32_t linktype() const override { return DLT_SPI_SEQUENCED; }
+    bool feed(int fd_fifo, const uint8_t* data, size_t len, uint64_t micros) override;
+    bool tick(int fd_fifo, uint64_t micros) override;
+    bool finish(int fd_fifo, uint64_t micros) override;
+
+private:
+    bool add_record(int fd_fifo, const SpiRecord& record, uint64_t micros);
+    bool write_held(int fd_fifo, bool last);
+
+    GroupingOptions options_;
+    RecordFramer framer_;
+
+    bool started_ = false;  // a group number was handed out
+    bool held_ = false;     // held_record_ is waiting to be written
+    bool held_first_ = false;
+    SpiRecord held_record_ = {};
+    uint64_t held_micros_ = 0;
+    uint32_t sequence_ = 0;
+    uint32_t group_ = 0;
+    uint32_t position_ = 0;
+};
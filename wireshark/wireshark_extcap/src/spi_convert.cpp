@@ -0,0 +1,80 @@
+// Converts saved sniffer captures (pcap, pcapng or raw UART dumps) into
+// waveform formats: VCD for GTKWave, sigrok .sr for PulseView, or a raw dump.
+// Records are streamed through, so captures of any size convert in constant memory.
+
+#include "capture_file.hpp"
+#include "export.hpp"
+#include "log.hpp"
+
+#include <string>
+
+static void print_usage(const char* name) {
+    std::cout << "Usage: " << name << " --input <capture> --output <file> [options]\n"
+                 "  --input <path>        pcap / pcapng from Wireshark or a raw UART dump\n"
+                 "  --output <path>       output file\n"
+                 "  --format <vcd|sr|raw> output format (default: from the output extension)\n"
+                 "  --samplerate <hz>     sigrok sample rate (default: 50000000)\n"
+                 "  --max-idle-ms <ms>    shorten longer idle periods in sigrok output (default: 0 = keep)\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string input_path;
+    std::string output_path;
+    std::string format;
+    uint64_t samplerate = 50000000;
+    uint64_t max_idle_ms = DEFAULT_SIGROK_MAX_IDLE_MS;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (arg == "--input" && i + 1 < argc) {
+            input_path = argv[++i];
+        } else if (arg == "--output" && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (arg == "--format" && i + 1 < argc) {
+            format = argv[++i];
+        } else if (arg == "--samplerate" && i + 1 < argc) {
+            samplerate = std::stoull(argv[++i]);
+        } else if (arg == "--max-idle-ms" && i + 1 < argc) {
+            max_idle_ms = std::stoull(argv[++i]);
+        } else if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            LOG_ERROR("Unknown argument: " << arg);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (input_path.empty() || output_path.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (format.empty()) {
+        format = export_format_for_path(output_path);
+    }
+
+    CaptureReader reader;
+    if (!reader.open(input_path)) {
+        return 1;
+    }
+
+    auto sink = make_record_sink(format, samplerate, max_idle_ms * (FPGA_CLOCK_HZ / 1000));
+    if (!sink) {
+        LOG_ERROR("Unknown output format: " << format);
+        return 1;
+    }
+    if (!sink->open(output_path)) {
+        return 1;
+    }
+
+    SpiRecord record;
+    while (reader.next(record)) {
+        sink->write(record);
+    }
+
+    bool ok = sink->finish() && !reader.failed();
+    LOG_INFO("Converted " << reader.records() << " records from " << input_path << " to " << output_path
+             << " (" << format << ")");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,282 @@
+// Compares the SPI traffic of two captures transaction by transaction, e.g. a
+// known-good firmware run against a new one. Both captures are decoded on
+// their own threads and streamed through a bounded-window matcher, so inputs
+// of any size are compared in constant memory. Exits with 0 when the captures
+// agree, 1 when they differ and 2 on errors.
+
+#include "capture_file.hpp"
+#include "log.hpp"
+#include "transaction.hpp"
+#include "transaction_diff.hpp"
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static constexpr size_t BATCH_SIZE = 1024;    // transactions per queue entry
+static constexpr size_t QUEUE_BATCHES = 8;    // batches in flight per capture
+
+static void print_usage(const char* name) {
+    std::cout << "Usage: " << name << " --baseline <capture> --candidate <capture> [options]\n"
+                 "  --baseline <path>     known-good capture (pcap, pcapng or raw UART dump)\n"
+                 "  --candidate <path>    capture to check against it\n"
+                 "  --gap-us <us>         SCLK stall that ends a transaction with CS low (default: 100)\n"
+                 "  --window <n>          transactions looked ahead per capture (default: 1024)\n"
+                 "  --anchor <n>          transactions that must agree to resync (default: 4)\n"
+                 "  --timing-tolerance <us>  report gap/duration changes above this (default: 0 = off)\n"
+                 "  --max-report <n>      differences printed in full (default: 100)\n";
+}
+
+// Hands batches of transactions from a decode thread to the matcher. Holds
+// at most QUEUE_BATCHES, so a fast reader waits for the matcher.
+class BatchQueue {
+public:
+    void push(std::vector<DiffTransaction>&& batch) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return batches_.size() < QUEUE_BATCHES; });
+        batches_.push_back(std::move(batch));
+        not_empty_.notify_one();
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_one();
+    }
+
+    // False once the queue is closed and drained
+    bool pop(std::vector<DiffTransaction>& batch) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return !batches_.empty() || closed_; });
+        if (batches_.empty()) {
+            return false;
+        }
+        batch = std::move(batches_.front());
+        batches_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<std::vector<DiffTransaction>> batches_;
+    bool closed_ = false;
+};
+
+// Decodes one capture into transactions on its own thread
+struct CaptureDecoder {
+    CaptureReader reader;
+    BatchQueue queue;
+    uint64_t transactions = 0;
+    std::thread thread;
+
+    void start(uint64_t gap_ticks) {
+        thread = std::thread([this, gap_ticks] { run(gap_ticks); });
+    }
+
+    void run(uint64_t gap_ticks) {
+        TransactionAssembler assembler(gap_ticks);
+        std::vector<DiffTransaction> batch;
+        batch.reserve(BATCH_SIZE);
+
+        auto add = [&](const SpiTransaction& transaction) {
+            batch.push_back(make_diff_transaction(transaction, transactions++));
+            if (batch.size() == BATCH_SIZE) {
+                queue.push(std::move(batch));
+                batch = std::vector<DiffTransaction>();
+                batch.reserve(BATCH_SIZE);
+            }
+        };
+
+        SpiRecord record;
+        while (reader.next(record)) {
+            assembler.push(record, add);
+        }
+        assembler.flush(add);
+
+        if (!batch.empty()) {
+            queue.push(std::move(batch));
+        }
+        queue.close();
+    }
+};
+
+// Time of a transaction in seconds since the first record of its capture
+static double seconds(const DiffTransaction& transaction, uint64_t origin) {
+    return double(transaction.start - origin) / FPGA_CLOCK_HZ;
+}
+
+static std::string payload_hex(const uint8_t* bytes, const DiffTransaction& transaction) {
+    std::string out;
+    char hex[4];
+    for (size_t i = 0; i < transaction.prefix_len; ++i) {
+        snprintf(hex, sizeof(hex), i ? " %02X" : "%02X", bytes[i]);
+        out += hex;
+    }
+    if ((transaction.bits + 7) / 8 > transaction.prefix_len) {
+        out += " ...";
+    }
+    return out;
+}
+
+static std::string describe(const DiffTransaction& transaction, uint64_t origin) {
+    char head[64];
+    snprintf(head, sizeof(head), "#%llu @%.6fs %u bits", (unsigned long long)transaction.index,
+             seconds(transaction, origin), transaction.bits);
+    return std::string(head) + "  MOSI " + payload_hex(transaction.mosi, transaction) +
+           "  MISO " + payload_hex(transaction.miso, transaction);
+}
+
+static double ticks_to_us(int64_t ticks) {
+    return double(ticks) * NS_PER_TICK / 1000.0;
+}
+
+int main(int argc, char* argv[]) {
+    std::string paths[2];
+    uint64_t gap_us = 100;
+    uint64_t tolerance_us = 0;
+    uint64_t max_report = 100;
+    DiffOptions options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (arg == "--baseline" && i + 1 < argc) {
+            paths[0] = argv[++i];
+        } else if (arg == "--candidate" && i + 1 < argc) {
+            paths[1] = argv[++i];
+        } else if (arg == "--gap-us" && i + 1 < argc) {
+            gap_us = std::stoull(argv[++i]);
+        } else if (arg == "--window" && i + 1 < argc) {
+            options.window = std::stoull(argv[++i]);
+        } else if (arg == "--anchor" && i + 1 < argc) {
+            options.anchor = std::stoull(argv[++i]);
+        } else if (arg == "--timing-tolerance" && i + 1 < argc) {
+            tolerance_us = std::stoull(argv[++i]);
+        } else if (arg == "--max-report" && i + 1 < argc) {
+            max_report = std::stoull(argv[++i]);
+        } else if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            LOG_ERROR("Unknown argument: " << arg);
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (paths[0].empty() || paths[1].empty()) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    options.timing_tolerance = tolerance_us * (FPGA_CLOCK_HZ / 1000000);
+
+    CaptureDecoder decoders[2];
+    for (int side = 0; side < 2; ++side) {
+        if (!decoders[side].reader.open(paths[side])) {
+            return 2;
+        }
+    }
+    for (CaptureDecoder& decoder : decoders) {
+        decoder.start(gap_us * (FPGA_CLOCK_HZ / 1000000));
+    }
+
+    TransactionMatcher matcher(options);
+    std::vector<DiffTransaction> batches[2];
+    size_t batch_pos[2] = {0, 0};
+    bool has_origin[2] = {false, false};
+    uint64_t origin[2] = {0, 0};
+    uint64_t reported = 0;
+
+    auto report = [&](const DiffEvent& event) {
+        if (reported++ >= max_report) {
+            if (reported == max_report + 1) {
+                std::cout << "... further differences only counted\n";
+            }
+            return;
+        }
+        switch (event.kind) {
+            case DiffEvent::Kind::Missing:
+                std::cout << "- missing   " << describe(*event.baseline, origin[0]) << "\n";
+                break;
+            case DiffEvent::Kind::Inserted:
+                std::cout << "+ inserted  " << describe(*event.candidate, origin[1]) << "\n";
+                break;
+            case DiffEvent::Kind::Changed:
+                std::cout << "~ changed   " << describe(*event.baseline, origin[0]) << "\n"
+                          << "         -> " << describe(*event.candidate, origin[1]) << "\n";
+                break;
+            case DiffEvent::Kind::Timing: {
+                char line[160];
+                snprintf(line, sizeof(line), "! timing    #%llu <-> #%llu  gap %+.3f us, duration %+.3f us\n",
+                         (unsigned long long)event.baseline->index, (unsigned long long)event.candidate->index,
+                         ticks_to_us(event.gap_delta), ticks_to_us(event.duration_delta));
+                std::cout << line;
+                break;
+            }
+        }
+    };
+
+    while (!matcher.done()) {
+        for (int side = 0; side < 2; ++side) {
+            while (matcher.wants(side)) {
+                if (batch_pos[side] == batches[side].size()) {
+                    batch_pos[side] = 0;
+                    if (!decoders[side].queue.pop(batches[side])) {
+                        batches[side].clear();
+                        matcher.end(side);
+                        break;
+                    }
+                }
+                const DiffTransaction& transaction = batches[side][batch_pos[side]++];
+                if (!has_origin[side]) {
+                    has_origin[side] = true;
+                    origin[side] = transaction.start;
+                }
+                matcher.push(side, transaction);
+            }
+        }
+        matcher.process(report);
+    }
+
+    for (CaptureDecoder& decoder : decoders) {
+        decoder.thread.join();
+    }
+
+    bool failed = false;
+    for (CaptureDecoder& decoder : decoders) {
+        if (decoder.reader.failed()) {
+            LOG_ERROR("Could not read all of " << decoder.reader.path());
+            failed = true;
+        }
+    }
+
+    const DiffStats& stats = matcher.stats();
+    char line[200];
+    snprintf(line, sizeof(line),
+             "baseline %llu transactions, candidate %llu: %llu matched, %llu changed, %llu missing, %llu inserted",
+             (unsigned long long)decoders[0].transactions, (unsigned long long)decoders[1].transactions,
+             (unsigned long long)stats.matched, (unsigned long long)stats.changed,
+             (unsigned long long)stats.missing, (unsigned long long)stats.inserted);
+    LOG_INFO(line);
+    if (stats.compared != 0) {
+        snprintf(line, sizeof(line),
+                 "timing: mean |gap delta| %.3f us, max |gap delta| %.3f us, max |duration delta| %.3f us",
+                 ticks_to_us(stats.gap_compared ? stats.sum_gap_delta / stats.gap_compared : 0), ticks_to_us(stats.max_gap_delta),
+                 ticks_to_us(stats.max_duration_delta));
+        LOG_INFO(line);
+    }
+    if (options.timing_tolerance != 0) {
+        LOG_INFO(stats.timing << " transaction pairs outside the timing tolerance of " << tolerance_us << " us");
+    }
+
+    if (failed) {
+        return 2;
+    }
+    return stats.differences() ? 1 : 0;
+}
@@ -0,0 +1,234 @@
+#include "spisniff.h"
+
+#include "capture_file.hpp"
+#include "record.hpp"
+#include "transaction.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+static_assert(sizeof(spisniff_record) == 16, "spisniff_record layout is part of the ABI");
+static_assert(sizeof(spisniff_transaction) == 24, "spisniff_transaction layout is part of the ABI");
+static_assert(SPISNIFF_RECORD_SIZE == RECORD_SIZE, "record size mismatch");
+
+struct spisniff_decoder {
+    RecordFramer framer;
+};
+
+struct spisniff_assembler {
+    explicit spisniff_assembler(uint64_t gap_ticks) : assembler(gap_ticks) {}
+
+    TransactionAssembler assembler;
+    // A completed transaction that did not fit into the caller's arrays yet
+    bool has_ready = false;
+    SpiTransaction ready;
+};
+
+struct spisniff_reader {
+    CaptureReader reader;
+};
+
+static void to_c_record(const SpiRecord& record, spisniff_record* out) {
+    out->timestamp = record.timestamp;
+    out->sclk_freq = record.sclk_freq;
+    out->miso = record.miso;
+    out->mosi = record.mosi;
+    out->cs = record.cs;
+    std::memset(out->reserved, 0, sizeof(out->reserved));
+}
+
+static SpiRecord from_c_record(const spisniff_record& record) {
+    SpiRecord out;
+    out.timestamp = record.timestamp;
+    out.sclk_freq = record.sclk_freq;
+    out.miso = record.miso != 0;
+    out.mosi = record.mosi != 0;
+    out.cs = record.cs != 0;
+    return out;
+}
+
+namespace {
+
+// Copies completed transactions into the caller's arrays
+struct TransactionOutput {
+    TransactionOutput(spisniff_assembler* assembler, spisniff_transaction* out, size_t max_transactions,
+                      uint8_t* mosi, uint8_t* miso, size_t payload_capacity)
+        : assembler(assembler), out(out), max_transactions(max_transactions),
+          mosi(mosi), miso(miso), payload_capacity(payload_capacity) {}
+
+    // Callback for the assembler: park the transaction until deliver()
+    auto keep() {
+        return [this](const SpiTransaction& transaction) {
+            assembler->ready = transaction;
+            assembler->has_ready = true;
+        };
+    }
+
+    // Moves the parked transaction out, false if there is no room left. It
+    // stays parked, whole, until a call brings enough room.
+    bool deliver() {
+        if (written == max_transactions) return false;
+
+        size_t bytes = assembler->ready.mosi.size();
+        if (payload_used + bytes > payload_capacity) return false;
+
+        spisniff_transaction& t = out[written++];
+        t.start = assembler->ready.start;
+        t.end = assembler->ready.end;
+        t.bits = assembler->ready.bits;
+        t.payload_offset = payload_used;
+        std::memcpy(mosi + payload_used, assembler->ready.mosi.data(), bytes);
+        std::memcpy(miso + payload_used, assembler->ready.miso.data(), bytes);
+        payload_used += bytes;
+        assembler->has_ready = false;
+        return true;
+    }
+
+    spisniff_assembler* assembler;
+    spisniff_transaction* out;
+    size_t max_transactions;
+    uint8_t* mosi;
+    uint8_t* miso;
+    size_t payload_capacity;
+    size_t written = 0;
+    size_t payload_used = 0;
+};
+
+} // namespace
+
+extern "C" {
+
+uint32_t spisniff_abi_version(void) {
+    return SPISNIFF_ABI_VERSION;
+}
+
+spisniff_decoder* spisniff_decoder_new(void) {
+    try {
+        return new spisniff_decoder();
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void spisniff_decoder_free(spisniff_decoder* decoder) {
+    delete decoder;
+}
+
+size_t spisniff_decode(spisniff_decoder* decoder, const uint8_t* data, size_t len, uint64_t host_micros,
+                       spisniff_record* out, size_t max_records, size_t* consumed) {
+    // Only take as many bytes as complete records fit into out; a trailing
+    // partial record is fine, the framer keeps it for the next call
+    size_t room = max_records * RECORD_SIZE + (RECORD_SIZE - 1);
+    size_t pending = decoder->framer.pending();
+    size_t take = room > pending ? std::min(len, room - pending) : 0;
+
+    size_t count = 0;
+    try {
+        decoder->framer.feed(data, take, host_micros, [&](const SpiRecord& record) {
+            to_c_record(record, &out[count++]);
+        });
+    } catch (...) {
+        return SPISNIFF_ERROR;
+    }
+
+    if (consumed) {
+        *consumed = take;
+    }
+    return count;
+}
+
+spisniff_assembler* spisniff_assembler_new(uint64_t gap_ticks) {
+    try {
+        return new spisniff_assembler(gap_ticks);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void spisniff_assembler_free(spisniff_assembler* assembler) {
+    delete assembler;
+}
+
+size_t spisniff_assemble(spisniff_assembler* assembler, const spisniff_record* records, size_t count,
+                         spisniff_transaction* out, size_t max_transactions,
+                         uint8_t* mosi, uint8_t* miso, size_t payload_capacity,
+                         size_t* records_consumed) {
+    TransactionOutput output(assembler, out, max_transactions, mosi, miso, payload_capacity);
+
+    size_t used = 0;
+    try {
+        if (!assembler->has_ready || output.deliver()) {
+            for (; used < count; ++used) {
+                assembler->assembler.push(from_c_record(records[used]), output.keep());
+                if (assembler->has_ready && !output.deliver()) {
+                    used++; // the record itself was consumed, its transaction waits
+                    break;
+                }
+            }
+        }
+    } catch (...) {
+        return SPISNIFF_ERROR;
+    }
+
+    if (records_consumed) {
+        *records_consumed = used;
+    }
+    return output.written;
+}
+
+size_t spisniff_assembler_flush(spisniff_assembler* assembler,
+                                spisniff_transaction* out, size_t max_transactions,
+                                uint8_t* mosi, uint8_t* miso, size_t payload_capacity) {
+    TransactionOutput output(assembler, out, max_transactions, mosi, miso, payload_capacity);
+
+    try {
+        if (!assembler->has_ready || output.deliver()) {
+            assembler->assembler.flush(output.keep());
+            if (assembler->has_ready) {
+                output.deliver();
+            }
+        }
+    } catch (...) {
+        return SPISNIFF_ERROR;
+    }
+    return output.written;
+}
+
+size_t spisniff_assembler_pending_bytes(const spisniff_assembler* assembler) {
+    return assembler->has_ready ? assembler->ready.mosi.size() : 0;
+}
+
+spisniff_reader* spisniff_reader_open(const char* path) {
+    spisniff_reader* reader = nullptr;
+    try {
+        reader = new spisniff_reader();
+        if (reader->reader.open(path)) {
+            return reader;
+        }
+    } catch (...) {
+    }
+    delete reader;
+    return nullptr;
+}
+
+void spisniff_reader_close(spisniff_reader* reader) {
+    delete reader;
+}
+
+int64_t spisniff_reader_read(spisniff_reader* reader, spisniff_record* out, size_t max_records) {
+    size_t count = 0;
+    SpiRecord record;
+    try {
+        while (count < max_records && reader->reader.next(record)) {
+            to_c_record(record, &out[count++]);
+        }
+    } catch (...) {
+        return -1;
+    }
+    if (count == 0 && reader->reader.failed()) {
+        return -1;
+    }
+    return count;
+}
+
+} // extern "C"
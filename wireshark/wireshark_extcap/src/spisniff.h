@@ -0,0 +1,113 @@
+/*
+ * libspisniff - C ABI over the sniffer's record and transaction decoder.
+ *
+ * Meant for bindings (see ../python/spisniff.py): every call fills arrays
+ * owned by the caller, so results can land directly in NumPy buffers without
+ * a per-record object. Structures only ever grow at the end; check
+ * spisniff_abi_version() before relying on a field.
+ *
+ * No C++ exception crosses the ABI. Calls returning size_t report a failure
+ * inside the library (in practice out of memory) as SPISNIFF_ERROR; the
+ * object they were called on should then only be freed.
+ */
+#ifndef SPISNIFF_H
+#define SPISNIFF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define SPISNIFF_API __attribute__((visibility("default")))
+#else
+#define SPISNIFF_API
+#endif
+
+#define SPISNIFF_ABI_VERSION 2
+#define SPISNIFF_RECORD_SIZE 6 /* bytes per record on the UART */
+#define SPISNIFF_ERROR ((size_t)-1)
+#define SPISNIFF_DEFAULT_GAP_TICKS 20000 /* 100 us, as --group-gap in the extcap */
+
+/* One decoded record (16 bytes) */
+typedef struct spisniff_record {
+    uint64_t timestamp;  /* unwrapped FPGA counter, 5 ns ticks */
+    uint16_t sclk_freq;  /* raw 13-bit value, x 131072 for Hz */
+    uint8_t  miso;
+    uint8_t  mosi;
+    uint8_t  cs;
+    uint8_t  reserved[3];
+} spisniff_record;
+
+/* One transaction (24 bytes). Its MOSI/MISO bytes are at payload_offset in
+ * the payload arrays passed to the call that returned it, (bits + 7) / 8 of them. */
+typedef struct spisniff_transaction {
+    uint64_t start;      /* first bit, FPGA ticks */
+    uint64_t end;        /* last bit, FPGA ticks */
+    uint32_t bits;
+    uint32_t payload_offset;
+} spisniff_transaction;
+
+typedef struct spisniff_decoder spisniff_decoder;
+typedef struct spisniff_assembler spisniff_assembler;
+typedef struct spisniff_reader spisniff_reader;
+
+SPISNIFF_API uint32_t spisniff_abi_version(void);
+
+/* Streaming decoder for the raw UART byte stream. Records may be split
+ * across calls at any byte. */
+SPISNIFF_API spisniff_decoder* spisniff_decoder_new(void);
+SPISNIFF_API void spisniff_decoder_free(spisniff_decoder* decoder);
+
+/* Decodes up to max_records records from data. *consumed receives the number
+ * of bytes used; call again with the rest if it is less than len.
+ * host_micros (0 if unknown) helps unwrap timestamps across long idle gaps.
+ * Returns the number of records written to out. */
+SPISNIFF_API size_t spisniff_decode(spisniff_decoder* decoder, const uint8_t* data, size_t len, uint64_t host_micros,
+                                    spisniff_record* out, size_t max_records, size_t* consumed);
+
+/* Groups records into transactions. A transaction ends when SCLK stalls for
+ * longer than gap_ticks (SPISNIFF_DEFAULT_GAP_TICKS is a good start) or at a
+ * record with CS high. The FPGA only writes records on SCLK edges, so such a
+ * record is rare and with gap_ticks 0 a whole capture is one transaction. */
+SPISNIFF_API spisniff_assembler* spisniff_assembler_new(uint64_t gap_ticks);
+SPISNIFF_API void spisniff_assembler_free(spisniff_assembler* assembler);
+
+/* Consumes records and writes completed transactions to out, with their
+ * bytes packed into mosi/miso (payload_capacity bytes each). Stops early when
+ * either output is full; *records_consumed tells how far it got. A
+ * transaction that does not fit waits in the assembler for the next call;
+ * if it is larger than payload_capacity, no progress is made until the call
+ * is repeated with spisniff_assembler_pending_bytes() of room.
+ * Returns the number of transactions written. */
+SPISNIFF_API size_t spisniff_assemble(spisniff_assembler* assembler, const spisniff_record* records, size_t count,
+                                      spisniff_transaction* out, size_t max_transactions,
+                                      uint8_t* mosi, uint8_t* miso, size_t payload_capacity,
+                                      size_t* records_consumed);
+
+/* Ends the capture: writes out the transaction still in progress, as well as
+ * one that earlier calls had no room for. Call until it returns 0 with
+ * nothing pending. */
+SPISNIFF_API size_t spisniff_assembler_flush(spisniff_assembler* assembler,
+                                             spisniff_transaction* out, size_t max_transactions,
+                                             uint8_t* mosi, uint8_t* miso, size_t payload_capacity);
+
+/* Payload bytes (per direction) of the completed transaction waiting for
+ * room, 0 if there is none. Since ABI version 2. */
+SPISNIFF_API size_t spisniff_assembler_pending_bytes(const spisniff_assembler* assembler);
+
+/* Reads records out of a pcap, pcapng or raw dump file. NULL if it cannot
+ * be opened. */
+SPISNIFF_API spisniff_reader* spisniff_reader_open(const char* path);
+SPISNIFF_API void spisniff_reader_close(spisniff_reader* reader);
+
+/* Returns the number of records read, 0 at end of file, -1 on error */
+SPISNIFF_API int64_t spisniff_reader_read(spisniff_reader* reader, spisniff_record* out, size_t max_records);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPISNIFF_H */
@@ -0,0 +1,145 @@
+#include "summary.hpp"
+#include "pcap.hpp"
+
+#include <algorithm>
+
+static void put_be(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+    for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+        out.push_back((value >> shift) & 0xFF);
+    }
+}
+
+void SummaryOutput::add_record(const SpiRecord& record) {
+    if (summary_.records == 0) {
+        summary_.fpga_start = record.timestamp;
+    }
+    summary_.fpga_end = record.timestamp;
+    summary_.records++;
+
+    if (record.sclk_freq != 0) {
+        if (summary_.sclk_samples == 0 || record.sclk_freq < summary_.sclk_min) summary_.sclk_min = record.sclk_freq;
+        if (record.sclk_freq > summary_.sclk_max) summary_.sclk_max = record.sclk_freq;
+        summary_.sclk_sum += record.sclk_freq;
+        summary_.sclk_samples++;
+    }
+
+    add_bit(record);
+}
+
+// Follows the transaction in progress; bytes are counted as they complete
+void SummaryOutput::add_bit(const SpiRecord& record) {
+    if (record.cs) {
+        if (active_) {
+            end_transaction();
+        }
+        return;
+    }
+
+    if (active_ && gap_ticks_ != 0 && record.timestamp - end_ > gap_ticks_) {
+        end_transaction();
+    }
+
+    if (!active_) {
+        active_ = true;
+        start_ = record.timestamp;
+        bits_ = 0;
+        summary_.transaction_starts++;
+    }
+
+    mosi_byte_ = uint8_t((mosi_byte_ << 1) | record.mosi);
+    miso_byte_ = uint8_t((miso_byte_ << 1) | record.miso);
+    end_ = record.timestamp;
+    bits_++;
+
+    if (bits_ % 8 != 0) {
+        return;
+    }
+    summary_.bytes_clocked++;
+    if (mosi_byte_ != 0x00 && mosi_byte_ != 0xFF) summary_.mosi_active_bytes++;
+    if (miso_byte_ != 0x00 && miso_byte_ != 0xFF) summary_.miso_active_bytes++;
+    if (bits_ == 8) {
+        command_ = mosi_byte_;
+    }
+}
+
+void SummaryOutput::end_transaction() {
+    active_ = false;
+    summary_.transactions++;
+
+    // The last bit takes one more SCLK period than the span of the samples
+    uint64_t span = end_ - start_;
+    summary_.busy_ticks += span + (bits_ > 1 ? span / (bits_ - 1) : 0);
+
+    // A partial first byte counts under its bits left-aligned, as before
+    uint8_t command = bits_ >= 8 ? command_ : uint8_t(mosi_byte_ << (8 - bits_));
+    summary_.command_counts[command]++;
+}
+
+bool SummaryOutput::feed(int fd_fifo, const uint8_t* data, size_t len, uint64_t micros) {
+    framer_.feed(data, len, micros, [this](const SpiRecord& record) { add_record(record); });
+    return tick(fd_fifo, micros);
+}
+
+bool SummaryOutput::tick(int fd_fifo, uint64_t micros) {
+    if (interval_start_ == 0) {
+        interval_start_ = micros;
+        return true;
+    }
+    if (micros - interval_start_ < uint64_t(interval_ms_) * 1000) {
+        return true;
+    }
+    return emit(fd_fifo, micros);
+}
+
+bool SummaryOutput::finish(int fd_fifo, uint64_t micros) {
+    if (active_) {
+        end_transaction();
+    }
+    if (interval_start_ == 0) {
+        interval_start_ = micros;
+    }
+    return emit(fd_fifo, micros);
+}
+
+bool SummaryOutput::emit(int fd_fifo, uint64_t micros) {
+    uint64_t elapsed_us = std::max<uint64_t>(micros - interval_start_, 1);
+    uint64_t interval_ticks = elapsed_us * (FPGA_CLOCK_HZ / 1000000);
+    uint64_t utilization = std::min<uint64_t>(summary_.busy_ticks * 10000 / interval_ticks, 10000);
+
+    uint16_t command_entries = 0;
+    for (uint32_t count : summary_.command_counts) {
+        if (count != 0) command_entries++;
+    }
+
+    packet_.clear();
+    put_be(packet_, SUMMARY_MAGIC, 4);
+    put_be(packet_, SUMMARY_VERSION, 1);
+    put_be(packet_, 0, 1);
+    put_be(packet_, command_entries, 2);
+    put_be(packet_, (elapsed_us + 500) / 1000, 4);
+    put_be(packet_, summary_.fpga_start, 8);
+    put_be(packet_, summary_.fpga_end, 8);
+    put_be(packet_, summary_.records, 4);
+    put_be(packet_, summary_.transactions, 4);
+    put_be(packet_, summary_.transaction_starts, 4);
+    put_be(packet_, summary_.bytes_clocked, 4);
+    put_be(packet_, summary_.mosi_active_bytes, 4);
+    put_be(packet_, summary_.miso_active_bytes, 4);
+    put_be(packet_, utilization, 2);
+    put_be(packet_, summary_.sclk_min, 2);
+    put_be(packet_, summary_.sclk_max, 2);
+    put_be(packet_, summary_.sclk_samples ? summary_.sclk_sum / summary_.sclk_samples : 0, 2);
+    for (int command = 0; command < 256; ++command) {
+        if (summary_.command_counts[command] != 0) {
+            put_be(packet_, command, 1);
+            put_be(packet_, summary_.command_counts[command], 4);
+        }
+    }
+
+    // Stamp the packet with the end of the interval it covers
+    bool ok = write_pcap_record(fd_fifo, micros, packet_.data(), packet_.size());
+
+    summary_ = BusSummary();
+    interval_start_ = micros;
+    return ok;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "output.hpp"
+#include "record.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Aggregates of one summary interval. Everything is fixed size, so memory
+// does not depend on how busy the bus is.
+struct BusSummary {
+    uint64_t fpga_start = 0;        // first record of the interval, FPGA ticks
+    uint64_t fpga_end = 0;          // last record of the interval, FPGA ticks
+    uint32_t records = 0;           // SCLK falling edges seen
+    uint32_t transactions = 0;      // completed CS low periods
+    uint32_t transaction_starts = 0; // transactions begun (after an SCLK gap or CS edge)
+    uint32_t bytes_clocked = 0;     // whole bytes per direction (full duplex)
+    uint32_t mosi_active_bytes = 0; // MOSI bytes other than 0x00 / 0xFF
+    uint32_t miso_active_bytes = 0; // MISO bytes other than 0x00 / 0xFF
+    uint64_t busy_ticks = 0;        // time spent inside transactions
+    uint16_t sclk_min = 0;          // raw SCLK frequency units, 0 = none seen
+    uint16_t sclk_max = 0;
+    uint64_t sclk_sum = 0;
+    uint32_t sclk_samples = 0;
+    uint32_t command_counts[256] = {}; // transactions per first MOSI byte
+};
+
+// Summary record, big endian like the FPGA records. One per interval:
+//   0   4  magic "SPIS"
+//   4   1  version (1)
+//   5   1  flags (reserved, 0)
+//   6   2  number of command entries N
+//   8   4  interval length, ms (host clock)
+//   12  8  first record, FPGA ticks
+//   20  8  last record, FPGA ticks
+//   28  4  records
+//   32  4  transactions
+//   36  4  transaction starts
+//   40  4  bytes clocked per direction
+//   44  4  active MOSI bytes
+//   48  4  active MISO bytes
+//   52  2  bus utilization, 1/10000 of the interval
+//   54  2  SCLK min, raw units (x 131072 Hz)
+//   56  2  SCLK max
+//   58  2  SCLK mean
+//   60  5N command entries: first MOSI byte (1), transactions (4)
+constexpr uint32_t SUMMARY_MAGIC = 0x53504953;
+constexpr uint8_t SUMMARY_VERSION = 1;
+constexpr size_t SUMMARY_HEADER_SIZE = 60;
+
+// Capture output for --capture-mode summary: instead of one packet per
+// record it keeps per-interval aggregates and writes one summary packet per
+// interval (DLT USER1). Transactions end at CS high or after an SCLK stall of
+// gap_ticks (0 = CS only); the FPGA only writes records on SCLK edges, so
+// without a gap a transaction would stay open until the next CS-high record.
+class SummaryOutput : public CaptureOutput {
+public:
+    SummaryOutput(uint32_t interval_ms, uint64_t gap_ticks) : interval_ms_(interval_ms), gap_ticks_(gap_ticks) {}
+
+    uint32_t linktype() const override { return DLT_SPI_SUMMARY; }
+    bool feed(int fd_fifo, const uint8_t* data, size_t len, uint64_t micros) override;
+    bool tick(int fd_fifo, uint64_t micros) override;
+    bool finish(int fd_fifo, uint64_t micros) override;
+
+private:
+    void add_record(const SpiRecord& record);
+    void add_bit(const SpiRecord& record);
+    void end_transaction();
+    bool emit(int fd_fifo, uint64_t micros);
+
+    uint32_t interval_ms_;
+    uint64_t gap_ticks_;
+    uint64_t interval_start_ = 0; // host micros, 0 until the first tick
+    BusSummary summary_;
+    std::vector<uint8_t> packet_;
+    RecordFramer framer_;
+
+    // Transaction in progress; only its first byte is kept, so memory does
+    // not depend on transaction length
+    bool active_ = false;
+    uint64_t start_ = 0;
+    uint64_t end_ = 0;
+    uint32_t bits_ = 0;
+    uint8_t mosi_byte_ = 0;
+    uint8_t miso_byte_ = 0;
+    uint8_t command_ = 0;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "record.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// One SPI transaction: the bits clocked while CS was held low (active low),
+// packed MSB first. A trailing partial byte is left-aligned, like the Lua
+// dissector does it.
+struct SpiTransaction {
+    uint64_t start = 0;  // timestamp of the first bit, FPGA ticks
+    uint64_t end = 0;    // timestamp of the last bit, FPGA ticks
+    uint32_t bits = 0;
+    std::vector<uint8_t> mosi;
+    std::vector<uint8_t> miso;
+    std::vector<uint64_t> byte_end; // timestamp of the last bit of every byte
+};
+
+// Groups records into transactions. A transaction ends when SCLK stalls for
+// longer than gap_ticks or at a record with CS high. The FPGA only writes
+// records on SCLK edges, so the gap is what normally ends one; with
+// gap_ticks 0 only the rare CS-high record does.
+class TransactionAssembler {
+public:
+    explicit TransactionAssembler(uint64_t gap_ticks = 0) : gap_ticks_(gap_ticks) {}
+
+    // Calls emit(const SpiTransaction&) for every transaction the record
+    // completes. The reference is only valid until the next push().
+    template <typename Emit>
+    void push(const SpiRecord& record, Emit&& emit) {
+        if (record.cs) {
+            if (active_) {
+                emit(finish());
+            }
+            return;
+        }
+
+        if (active_ && gap_ticks_ != 0 && record.timestamp - current_.end > gap_ticks_) {
+            emit(finish());
+        }
+
+        if (!active_) {
+            active_ = true;
+            current_.start = record.timestamp;
+            current_.bits = 0;
+            current_.mosi.clear();
+            current_.miso.clear();
+            current_.byte_end.clear();
+        }
+
+        uint32_t bit_in_byte = current_.bits % 8;
+        if (bit_in_byte == 0) {
+            current_.mosi.push_back(0);
+            current_.miso.push_back(0);
+            current_.byte_end.push_back(0);
+        }
+        uint8_t mask = 0x80 >> bit_in_byte;
+        if (record.mosi) current_.mosi.back() |= mask;
+        if (record.miso) current_.miso.back() |= mask;
+        current_.byte_end.back() = record.timestamp;
+        current_.end = record.timestamp;
+        current_.bits++;
+    }
+
+    // Emits the transaction still in progress, if any
+    template <typename Emit>
+    void flush(Emit&& emit) {
+        if (active_) {
+            emit(finish());
+        }
+    }
+
+    bool active() const { return active_; }
+
+private:
+    const SpiTransaction& finish() {
+        active_ = false;
+        return current_;
+    }
+
+    uint64_t gap_ticks_;
+    bool active_ = false;
+    SpiTransaction current_;
+};
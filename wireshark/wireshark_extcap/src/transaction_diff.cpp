@@ -0,0 +1,294 @@
+#include "transaction_diff.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+static constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+static constexpr uint64_t FNV_PRIME = 0x100000001b3ULL;
+static constexpr uint64_t ROLL_BASE = 0x9E3779B97F4A7C15ULL;
+static constexpr uint64_t END_MARKER_HASH = 0x454E442D4D41524BULL;
+
+static uint64_t fnv1a(uint64_t hash, const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// Spreads the FNV result over all bits before it goes into the rolling hash
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+DiffTransaction make_diff_transaction(const SpiTransaction& transaction, uint64_t index) {
+    DiffTransaction out;
+    out.index = index;
+    out.start = transaction.start;
+    out.end = transaction.end;
+    out.bits = transaction.bits;
+
+    uint8_t length[4] = {
+        uint8_t(transaction.bits >> 24), uint8_t(transaction.bits >> 16),
+        uint8_t(transaction.bits >> 8), uint8_t(transaction.bits),
+    };
+    uint64_t hash = fnv1a(FNV_OFFSET, length, sizeof(length));
+    hash = fnv1a(hash, transaction.mosi.data(), transaction.mosi.size());
+    out.mosi_hash = mix(hash);
+    out.hash = mix(fnv1a(hash, transaction.miso.data(), transaction.miso.size()));
+
+    out.prefix_len = std::min(transaction.mosi.size(), DIFF_PREFIX_BYTES);
+    std::memcpy(out.mosi, transaction.mosi.data(), out.prefix_len);
+    std::memcpy(out.miso, transaction.miso.data(), out.prefix_len);
+    return out;
+}
+
+TransactionMatcher::TransactionMatcher(const DiffOptions& options) : options_(options) {
+    options_.anchor = std::max<size_t>(options_.anchor, 1);
+    // Room for a front entry plus the run after it
+    options_.window = std::max(options_.window, options_.anchor + 1);
+    for (size_t i = 0; i < options_.anchor; ++i) {
+        base_power_ *= ROLL_BASE;
+    }
+    for (Side& side : sides_) {
+        side.recent.assign(options_.anchor, 0);
+    }
+}
+
+bool TransactionMatcher::wants(int side) const {
+    return !sides_[side].ended && sides_[side].window.size() < options_.window;
+}
+
+bool TransactionMatcher::ready(int side) const {
+    return sides_[side].ended || sides_[side].window.size() >= options_.window;
+}
+
+bool TransactionMatcher::done() const {
+    return sides_[0].ended && sides_[1].ended && sides_[0].real == 0 && sides_[1].real == 0;
+}
+
+void TransactionMatcher::push(int side, const DiffTransaction& transaction) {
+    append(sides_[side], transaction);
+}
+
+void TransactionMatcher::end(int side) {
+    // Pad with anchor - 1 end markers so the last transactions also start a
+    // full run; both captures end the same way, so their tails still match
+    DiffTransaction marker;
+    marker.end_marker = true;
+    marker.hash = END_MARKER_HASH;
+    for (size_t i = 1; i < options_.anchor; ++i) {
+        append(sides_[side], marker);
+    }
+    sides_[side].ended = true;
+}
+
+void TransactionMatcher::append(Side& side, const DiffTransaction& transaction) {
+    Entry entry;
+    entry.transaction = transaction;
+    side.window.push_back(entry);
+    if (!transaction.end_marker) {
+        side.real++;
+    }
+
+    // Roll the new hash in and the one anchor places back out
+    size_t slot = side.pushed % options_.anchor;
+    side.roll = side.roll * ROLL_BASE + transaction.hash - side.recent[slot] * base_power_;
+    side.recent[slot] = transaction.hash;
+    side.pushed++;
+
+    // The run that starts anchor - 1 entries back is now complete
+    if (side.pushed >= options_.anchor) {
+        uint64_t start = side.pushed - options_.anchor;
+        if (start >= side.base) {
+            side.window[start - side.base].run_hash = side.roll;
+            side.runs[side.roll].push_back(start);
+        }
+    }
+}
+
+void TransactionMatcher::pop(Side& side) {
+    const Entry& front = side.window.front();
+    if (has_run(side, 0)) {
+        auto it = side.runs.find(front.run_hash);
+        if (it != side.runs.end()) {
+            it->second.pop_front();
+            if (it->second.empty()) {
+                side.runs.erase(it);
+            }
+        }
+    }
+    if (!front.transaction.end_marker) {
+        side.real--;
+    }
+    side.window.pop_front();
+    side.base++;
+}
+
+bool TransactionMatcher::has_run(const Side& side, size_t offset) const {
+    return offset + options_.anchor <= side.window.size();
+}
+
+size_t TransactionMatcher::find_run(const Side& side, uint64_t run_hash) const {
+    auto it = side.runs.find(run_hash);
+    if (it == side.runs.end() || it->second.empty()) {
+        return 0;
+    }
+    return it->second.front() - side.base;
+}
+
+void TransactionMatcher::compare(const DiffTransaction& a, const DiffTransaction& b, bool changed,
+                                 std::vector<DiffEvent>& events) {
+    Side& baseline = sides_[0];
+    Side& candidate = sides_[1];
+
+    DiffEvent event;
+    event.baseline = &a;
+    event.candidate = &b;
+    event.duration_delta = int64_t(b.end - b.start) - int64_t(a.end - a.start);
+    if (baseline.compared && candidate.compared) {
+        event.gap_delta = int64_t(b.start - candidate.last_start) - int64_t(a.start - baseline.last_start);
+        stats_.gap_compared++;
+    }
+    baseline.compared = candidate.compared = true;
+    baseline.last_start = a.start;
+    candidate.last_start = b.start;
+
+    uint64_t gap = event.gap_delta < 0 ? -event.gap_delta : event.gap_delta;
+    uint64_t duration = event.duration_delta < 0 ? -event.duration_delta : event.duration_delta;
+    stats_.compared++;
+    stats_.sum_gap_delta += gap;
+    stats_.max_gap_delta = std::max(stats_.max_gap_delta, gap);
+    stats_.max_duration_delta = std::max(stats_.max_duration_delta, duration);
+
+    if (changed) {
+        stats_.changed++;
+        event.kind = DiffEvent::Kind::Changed;
+        events.push_back(event);
+    } else {
+        stats_.matched++;
+    }
+
+    if (options_.timing_tolerance != 0 && (gap > options_.timing_tolerance || duration > options_.timing_tolerance)) {
+        stats_.timing++;
+        event.kind = DiffEvent::Kind::Timing;
+        events.push_back(event);
+    }
+}
+
+// Called when transactions were reported missing or inserted. The gap to the
+// previous compared pair would span them on one side only, so the next pair
+// gets no gap delta.
+void TransactionMatcher::skipped() {
+    sides_[0].compared = sides_[1].compared = false;
+}
+
+void TransactionMatcher::decide(std::vector<DiffEvent>& events) {
+    Side& a = sides_[0];
+    Side& b = sides_[1];
+
+    // Padding only: drop it once the other side has caught up
+    if (a.real == 0 || b.real == 0) {
+        for (int index = 0; index < 2; ++index) {
+            Side& side = sides_[index];
+            Side& other = sides_[1 - index];
+            if (side.real != 0 || !side.ended) continue;
+            if (other.real == 0) {
+                pending_pops_[index] = side.window.size();
+                continue;
+            }
+            // Everything left on the other side has no counterpart
+            const Entry& front = other.window.front();
+            if (!front.transaction.end_marker) {
+                DiffEvent event;
+                event.kind = index == 0 ? DiffEvent::Kind::Inserted : DiffEvent::Kind::Missing;
+                (index == 0 ? event.candidate : event.baseline) = &front.transaction;
+                (index == 0 ? stats_.inserted : stats_.missing)++;
+                events.push_back(event);
+            }
+            pending_pops_[1 - index] = 1;
+            skipped();
+            return;
+        }
+        return;
+    }
+
+    const DiffTransaction& front_a = a.window.front().transaction;
+    const DiffTransaction& front_b = b.window.front().transaction;
+
+    if (front_a.hash == front_b.hash && front_a.end_marker == front_b.end_marker) {
+        if (!front_a.end_marker) {
+            compare(front_a, front_b, false, events);
+        }
+        pending_pops_[0] = pending_pops_[1] = 1;
+        return;
+    }
+
+    // One transaction replaced by another, the runs after them agree
+    if (has_run(a, 1) && has_run(b, 1) && a.window[1].run_hash == b.window[1].run_hash &&
+        !front_a.end_marker && !front_b.end_marker) {
+        compare(front_a, front_b, true, events);
+        pending_pops_[0] = pending_pops_[1] = 1;
+        return;
+    }
+
+    // Nearest resync: the baseline's front run later in the candidate means
+    // inserted transactions, the other way round missing ones
+    size_t inserted = has_run(a, 0) ? find_run(b, a.window.front().run_hash) : 0;
+    size_t missing = has_run(b, 0) ? find_run(a, b.window.front().run_hash) : 0;
+
+    if (inserted != 0 && (missing == 0 || inserted <= missing)) {
+        for (size_t i = 0; i < inserted; ++i) {
+            const DiffTransaction& t = b.window[i].transaction;
+            if (t.end_marker) continue;
+            DiffEvent event;
+            event.kind = DiffEvent::Kind::Inserted;
+            event.candidate = &t;
+            events.push_back(event);
+            stats_.inserted++;
+        }
+        pending_pops_[1] = inserted;
+        skipped();
+        return;
+    }
+    if (missing != 0) {
+        for (size_t i = 0; i < missing; ++i) {
+            const DiffTransaction& t = a.window[i].transaction;
+            if (t.end_marker) continue;
+            DiffEvent event;
+            event.kind = DiffEvent::Kind::Missing;
+            event.baseline = &t;
+            events.push_back(event);
+            stats_.missing++;
+        }
+        pending_pops_[0] = missing;
+        skipped();
+        return;
+    }
+
+    // No resync within the window: pair the fronts up as changed
+    if (front_a.end_marker) {
+        DiffEvent event;
+        event.kind = DiffEvent::Kind::Inserted;
+        event.candidate = &front_b;
+        events.push_back(event);
+        stats_.inserted++;
+        pending_pops_[1] = 1;
+        skipped();
+    } else if (front_b.end_marker) {
+        DiffEvent event;
+        event.kind = DiffEvent::Kind::Missing;
+        event.baseline = &front_a;
+        events.push_back(event);
+        stats_.missing++;
+        pending_pops_[0] = 1;
+        skipped();
+    } else {
+        compare(front_a, front_b, true, events);
+        pending_pops_[0] = pending_pops_[1] = 1;
+    }
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "transaction.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+// Bytes of each direction kept per transaction for the report; the hashes
+// always cover the whole payload
+constexpr size_t DIFF_PREFIX_BYTES = 16;
+
+// What the matcher keeps of a transaction: its timing, content hashes and
+// the start of the payload. Fixed size, whatever the transaction length.
+struct DiffTransaction {
+    uint64_t index = 0;     // position in its capture, from 0
+    uint64_t start = 0;     // FPGA ticks
+    uint64_t end = 0;
+    uint32_t bits = 0;
+    uint64_t hash = 0;      // length, MOSI and MISO
+    uint64_t mosi_hash = 0; // length and MOSI only
+    uint8_t prefix_len = 0;
+    uint8_t mosi[DIFF_PREFIX_BYTES] = {};
+    uint8_t miso[DIFF_PREFIX_BYTES] = {};
+    bool end_marker = false; // padding after the last transaction, never reported
+};
+
+DiffTransaction make_diff_transaction(const SpiTransaction& transaction, uint64_t index);
+
+struct DiffOptions {
+    size_t window = 1024;           // transactions looked ahead per capture
+    size_t anchor = 4;              // consecutive transactions that must agree to resync
+    uint64_t timing_tolerance = 0;  // FPGA ticks, 0 = report timing deltas without judging them
+};
+
+struct DiffEvent {
+    enum class Kind { Missing, Inserted, Changed, Timing };
+
+    Kind kind;
+    const DiffTransaction* baseline = nullptr;  // null for Inserted
+    const DiffTransaction* candidate = nullptr; // null for Missing
+    int64_t gap_delta = 0;      // change of the time since the previous compared transaction, ticks;
+                                // 0 for the first pair and the first after a skip
+    int64_t duration_delta = 0; // change of the transaction length, ticks
+};
+
+struct DiffStats {
+    uint64_t matched = 0;
+    uint64_t changed = 0;
+    uint64_t missing = 0;
+    uint64_t inserted = 0;
+    uint64_t timing = 0;          // compared pairs outside the timing tolerance
+    uint64_t compared = 0;        // pairs the timing deltas are taken over
+    uint64_t gap_compared = 0;    // of those, pairs with a gap delta (not the first after a skip)
+    uint64_t max_gap_delta = 0;   // largest |gap delta|, ticks
+    uint64_t max_duration_delta = 0;
+    uint64_t sum_gap_delta = 0;   // sum of |gap delta|, for the mean
+
+    bool differences() const { return changed || missing || inserted || timing; }
+};
+
+// Aligns two transaction streams in bounded memory. Each capture gets a
+// window of at most `window` transactions; equal fronts match, otherwise the
+// matcher looks for the nearest point where `anchor` consecutive transactions
+// agree again, using a rolling hash over the transaction hashes, and reports
+// what it skipped as missing or inserted. Timestamps play no part in the
+// alignment, so jitter and clock offsets between the runs do not matter.
+class TransactionMatcher {
+public:
+    explicit TransactionMatcher(const DiffOptions& options);
+
+    // side 0 is the baseline, side 1 the candidate
+    bool wants(int side) const;
+    void push(int side, const DiffTransaction& transaction);
+    void end(int side);
+
+    // Consumes as much as can be decided; calls emit(const DiffEvent&).
+    // The pointers in the event are only valid during the call.
+    template <typename Emit>
+    void process(Emit&& emit) {
+        while (ready(0) && ready(1) && !done()) {
+            step(emit);
+        }
+    }
+
+    bool done() const;
+    const DiffStats& stats() const { return stats_; }
+
+private:
+    struct Entry {
+        DiffTransaction transaction;
+        uint64_t run_hash = 0; // rolling hash of the anchor run starting here
+    };
+
+    struct Side {
+        std::deque<Entry> window;
+        uint64_t base = 0;   // absolute position of window.front()
+        uint64_t pushed = 0; // entries ever pushed, padding included
+        size_t real = 0;     // entries in the window that are not padding
+        bool ended = false;
+        std::vector<uint64_t> recent; // last `anchor` hashes, ring
+        uint64_t roll = 0;
+        // run hash -> absolute positions in the window, ascending
+        std::unordered_map<uint64_t, std::deque<uint64_t>> runs;
+        bool compared = false;  // last_start belongs to the pair just before
+        uint64_t last_start = 0;
+    };
+
+    bool ready(int side) const;
+    void append(Side& side, const DiffTransaction& transaction);
+    void pop(Side& side);
+    // Offset of the first window entry whose run starts with run_hash, 0 if none
+    size_t find_run(const Side& side, uint64_t run_hash) const;
+    bool has_run(const Side& side, size_t offset) const;
+    void compare(const DiffTransaction& a, const DiffTransaction& b, bool changed, std::vector<DiffEvent>& events);
+    void skipped();
+
+    template <typename Emit>
+    void step(Emit& emit) {
+        events_.clear();
+        decide(events_);
+        for (const DiffEvent& event : events_) {
+            emit(event);
+        }
+        // Popping only after the events went out keeps their pointers valid
+        for (int side = 0; side < 2; ++side) {
+            for (; pending_pops_[side] > 0; --pending_pops_[side]) {
+                pop(sides_[side]);
+            }
+        }
+    }
+
+    void decide(std::vector<DiffEvent>& events);
+
+    DiffOptions options_;
+    uint64_t base_power_ = 1; // B^anchor, to roll the oldest hash out
+    Side sides_[2];
+    DiffStats stats_;
+    std::vector<DiffEvent> events_;
+    size_t pending_pops_[2] = {0, 0};
+};
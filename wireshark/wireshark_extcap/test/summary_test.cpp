@@ -0,0 +1,109 @@
+// Checks the summary counters against a synthetic record stream.
+// Built and run by `make test` in wireshark/.
+
+#include "../src/summary.hpp"
+#include "../src/pcap.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK_EQ(actual, expected)                                                        \
+    do {                                                                                  \
+        uint64_t a_ = (actual), e_ = (expected);                                          \
+        if (a_ != e_) {                                                                   \
+            std::fprintf(stderr, "%s:%d: %s = %llu, expected %llu\n", __FILE__, __LINE__, \
+                         #actual, (unsigned long long)a_, (unsigned long long)e_);        \
+            failures++;                                                                   \
+        }                                                                                 \
+    } while (0)
+
+static uint64_t get_be(const uint8_t* data, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+// Runs records through a SummaryOutput with a 100 us gap and returns the
+// single summary packet it writes on finish()
+static std::vector<uint8_t> summarize(const std::vector<SpiRecord>& records) {
+    std::vector<uint8_t> stream(records.size() * RECORD_SIZE);
+    for (size_t i = 0; i < records.size(); ++i) {
+        encode_record(records[i], &stream[i * RECORD_SIZE]);
+    }
+
+    FILE* file = std::tmpfile();
+    int fd = fileno(file);
+    // An interval longer than the test, so everything lands in one packet
+    SummaryOutput output(60000, 20000);
+    output.tick(fd, 1);
+    output.feed(fd, stream.data(), stream.size(), 2);
+    output.finish(fd, 3);
+
+    std::vector<uint8_t> packet(65536);
+    ssize_t len = pread(fd, packet.data(), packet.size(), 0);
+    std::fclose(file);
+    if (len < ssize_t(sizeof(pcaprec_hdr_t) + SUMMARY_HEADER_SIZE)) {
+        std::fprintf(stderr, "no summary packet written\n");
+        std::exit(1);
+    }
+    return std::vector<uint8_t>(packet.begin() + sizeof(pcaprec_hdr_t), packet.begin() + len);
+}
+
+// Transactions of 16 bits, 1 MHz SCLK, 500 us apart; CS stays low throughout
+// because the FPGA only writes records on SCLK edges
+static void test_gap_separated_transactions() {
+    const int transactions = 7;
+    std::vector<SpiRecord> records;
+    uint64_t t = 1000;
+    for (int n = 0; n < transactions; ++n) {
+        for (int bit = 0; bit < 16; ++bit) {
+            records.push_back({t, 8, false, bit == 7, false}); // first byte 0x01
+            t += 200;
+        }
+        t += 100000;
+    }
+
+    std::vector<uint8_t> packet = summarize(records);
+    CHECK_EQ(get_be(&packet[28], 4), transactions * 16); // records
+    CHECK_EQ(get_be(&packet[32], 4), transactions);      // transactions
+    CHECK_EQ(get_be(&packet[36], 4), transactions);      // transaction starts
+    CHECK_EQ(get_be(&packet[40], 4), transactions * 2);  // bytes clocked
+    CHECK_EQ(get_be(&packet[6], 2), 1);                  // command entries
+    CHECK_EQ(get_be(&packet[60], 1), 0x01);
+    CHECK_EQ(get_be(&packet[61], 4), transactions);
+}
+
+// A CS-high record ends a transaction without waiting for the gap
+static void test_cs_high_record() {
+    std::vector<SpiRecord> records;
+    uint64_t t = 1000;
+    for (int n = 0; n < 3; ++n) {
+        for (int bit = 0; bit < 8; ++bit) {
+            records.push_back({t, 8, false, false, false});
+            t += 200;
+        }
+        records.push_back({t, 8, false, false, true});
+        t += 200;
+    }
+
+    std::vector<uint8_t> packet = summarize(records);
+    CHECK_EQ(get_be(&packet[32], 4), 3);
+    CHECK_EQ(get_be(&packet[36], 4), 3);
+}
+
+int main() {
+    test_gap_separated_transactions();
+    test_cs_high_record();
+    if (failures != 0) {
+        std::fprintf(stderr, "summary_test: %d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("summary_test: OK\n");
+    return 0;
+}